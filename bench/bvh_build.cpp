@@ -0,0 +1,114 @@
+// Measures how bvh_builder's build time scales with thread count and scene
+// size, against the single threaded median split bvh_node, and checks that
+// every tree finds the same hits.
+#include <cfloat>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "sphere.h"
+#include "bvh.h"
+#include "bvh_build.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+double
+milliseconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+std::vector<hittable*>
+random_spheres(size_t count, unsigned short seed[3])
+{
+    // Spread them out so the density stays about the same as count grows.
+    float side = cbrt(float(count)) * 2;
+    std::vector<hittable*> spheres;
+    spheres.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        vec3<> center(side * erand48(seed), side * erand48(seed), side * erand48(seed));
+        spheres.push_back(new sphere(center, 0.1 + 0.4 * erand48(seed), nullptr));
+    }
+    return spheres;
+}
+
+// Casts the same rays through 'world', returns how many hit and the sum of the
+// hit distances so different trees can be compared.
+double
+cast_rays(const hittable *world, size_t count, float side, int &hits)
+{
+    unsigned short seed[3] = {0x1234, 0xabcd, 0x330e};
+    double t_sum = 0;
+    hits = 0;
+    for (size_t i = 0; i < count; i++) {
+        vec3<> origin(side * erand48(seed), side * erand48(seed), side * erand48(seed));
+        vec3<> direction(erand48(seed) - 0.5, erand48(seed) - 0.5, erand48(seed) - 0.5);
+        hit_record rec;
+        if (world->hit(ray<float>(origin, direction), 0.001, FLT_MAX, rec)) {
+            hits++;
+            t_sum += rec.t;
+        }
+    }
+    return t_sum;
+}
+
+// usage: bvh_build [max threads]
+int main(int argc, char **argv)
+{
+    unsigned max_threads = argc > 1 ? atoi(argv[1])
+                                    : std::thread::hardware_concurrency();
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads ? max_threads : 1);
+
+    size_t sizes[] = {10000, 100000, 1000000};
+    const size_t rays = 100000;
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t size : sizes) {
+        unsigned short seed[3] = {0x1234, 0xabcd, 0x330e};
+        std::vector<hittable*> spheres = random_spheres(size, seed);
+        float side = cbrt(float(size)) * 2;
+
+        // Nothing here frees the trees: the benchmark is short lived and the
+        // objects are shared between them.
+        auto start = bench_clock::now();
+        std::vector<hittable*> copy(spheres);
+        bvh_node *median = new bvh_node(copy);
+        double median_ms = milliseconds_since(start);
+        int median_hits;
+        start = bench_clock::now();
+        double median_t = cast_rays(median, rays, side, median_hits);
+        double median_trace_ms = milliseconds_since(start);
+
+        std::cout << size << " spheres, median split: build " << median_ms
+                  << " ms, trace " << median_trace_ms << " ms" << std::endl;
+
+        double single_ms = 0;
+        for (unsigned threads : thread_counts) {
+            start = bench_clock::now();
+            hittable *sah = build_bvh(spheres, threads);
+            double ms = milliseconds_since(start);
+            if (threads == 1) {
+                single_ms = ms;
+            }
+
+            int hits;
+            start = bench_clock::now();
+            double t = cast_rays(sah, rays, side, hits);
+            double trace_ms = milliseconds_since(start);
+
+            std::cout << size << " spheres, binned SAH, " << threads
+                      << " threads: build " << ms << " ms ("
+                      << std::setprecision(2) << single_ms / ms << "x), trace "
+                      << std::setprecision(1) << trace_ms << " ms"
+                      << (hits == median_hits && fabs(t - median_t) < 1e-3 * median_t
+                          ? "" : " MISMATCH")
+                      << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Measures how fast each sampler converges: renders a small view of
+// random_scene() at increasing sample counts and compares each render with a
+// high sample count reference, printing the RMS error.  With plain random
+// sampling the error halves every time the sample count quadruples; the
+// better samplers should do better than that.
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "camera.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "scenes.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+const int nx = 48;
+const int ny = 32;
+
+template<typename S> std::vector<vec3<> >
+render_image(const camera &cam, const hittable &world, const scene_lights &lights,
+             int samples, S &pixel_sampler)
+{
+    std::vector<vec3<> > image(nx * ny);
+    current_sampler() = &pixel_sampler;
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            vec3<> col(0, 0, 0);
+            for (int s = 0; s < samples; s++) {
+                pixel_sampler.start_sample(i, j, s);
+                float du, dv;
+                random_float2(du, dv);
+                ray<float> r = cam.get_ray((i + du) / float(nx), (j + dv) / float(ny));
+                col += color(r, &world, lights);
+            }
+            image[j*nx + i] = col / float(samples);
+        }
+    }
+    current_sampler() = nullptr;
+    return image;
+}
+
+double
+rms_error(const std::vector<vec3<> > &image, const std::vector<vec3<> > &reference)
+{
+    double sum = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+        sum += (image[i] - reference[i]).squared_length() / 3;
+    }
+    return sqrt(sum / image.size());
+}
+
+template<typename S> void
+measure(const char *name, const camera &cam, const hittable &world,
+        const scene_lights &lights, const std::vector<vec3<> > &reference,
+        int max_samples)
+{
+    std::cout << std::setw(20) << std::left << name << std::right;
+    for (int samples = 1; samples <= max_samples; samples *= 2) {
+        S pixel_sampler(samples);
+        std::vector<vec3<> > image = render_image(cam, world, lights, samples,
+                                                  pixel_sampler);
+        std::cout << std::setw(10) << std::setprecision(4) << rms_error(image, reference);
+    }
+    std::cout << std::endl;
+}
+
+// usage: convergence [max samples] [reference samples]
+int main(int argc, char **argv)
+{
+    int max_samples = argc > 1 ? atoi(argv[1]) : 128;
+    int reference_samples = argc > 2 ? atoi(argv[2]) : 4096;
+
+    hittable_list objects = random_scene();
+    hittable *world = build_bvh(std::vector<hittable*>(objects.objects().begin(),
+                                                       objects.objects().end()), 1);
+    scene_lights lights;
+    camera cam(vec3<>(13, 2, 3), vec3<>(0, 0, 0), vec3<>(0, 1, 0),
+               20, float(nx)/float(ny), 0.1, 10.0);
+
+    // The reference gets its own seed, so its errors aren't correlated with
+    // the random_sampler renders it's compared with.
+    auto start = bench_clock::now();
+    random_sampler reference_sampler(reference_samples, 0x5eed);
+    std::vector<vec3<> > reference =
+        render_image(cam, *world, lights, reference_samples, reference_sampler);
+    std::cerr << "reference (" << reference_samples << " spp) took "
+              << std::chrono::duration<double>(bench_clock::now() - start).count()
+              << "s" << std::endl;
+
+    std::cout << "RMS error against the reference, by samples per pixel" << std::endl;
+    std::cout << std::setw(20) << std::left << "sampler" << std::right;
+    for (int samples = 1; samples <= max_samples; samples *= 2) {
+        std::cout << std::setw(10) << samples;
+    }
+    std::cout << std::endl;
+
+    measure<random_sampler>("random", cam, *world, lights, reference, max_samples);
+    measure<stratified_sampler>("stratified", cam, *world, lights, reference, max_samples);
+    measure<halton_sampler>("halton", cam, *world, lights, reference, max_samples);
+    measure<sobol_sampler>("sobol (owen)", cam, *world, lights, reference, max_samples);
+    return 0;
+}
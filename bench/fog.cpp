@@ -0,0 +1,94 @@
+// Compares the cost of fog_scene()'s ways of making fog against rendering
+// the same scene without any: a constant_medium, which scatters rays at a
+// distance drawn from one random number, and the old stand-in of a cloud of
+// tiny glass bubbles, which every ray has to find in the bvh and refract its
+// way through.  Also prints each image's average brightness, so it's clear
+// the fog is actually there.
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "scenes.h"
+
+const int nx = 120;
+const int ny = 80;
+
+std::vector<vec3<> >
+render_image(const camera &cam, const hittable &world, const scene_lights &lights,
+             int samples)
+{
+    std::vector<vec3<> > image(nx * ny);
+    sobol_sampler pixel_sampler(samples);
+    current_sampler() = &pixel_sampler;
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            vec3<> col(0, 0, 0);
+            for (int s = 0; s < samples; s++) {
+                pixel_sampler.start_sample(i, j, s);
+                float du, dv;
+                random_float2(du, dv);
+                ray<float> r = cam.get_ray((i + du) / float(nx), (j + dv) / float(ny));
+                col += color(r, &world, lights);
+            }
+            image[j*nx + i] = col / float(samples);
+        }
+    }
+    current_sampler() = nullptr;
+    return image;
+}
+
+// usage: fog [samples] [runs]
+int main(int argc, char **argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 8;
+    int runs = argc > 2 ? atoi(argv[2]) : 3;
+
+    const char *kinds[] = {"none", "medium", "bubbles"};
+    const int kind_count = sizeof(kinds)/sizeof(*kinds);
+    hittable *worlds[kind_count];
+    for (int k = 0; k < kind_count; k++) {
+        reset_scene_seed();
+        worlds[k] = fog_scene(kinds[k]);
+    }
+
+    scene_lights lights;
+    camera cam(vec3<>(13, 2, 3), vec3<>(0, 0, 0), vec3<>(0, 1, 0),
+               20, float(nx)/float(ny), 0.1, 10.0);
+
+    // CPU seconds, best of 'runs', taking turns so a slow patch on the
+    // machine hits them all about the same.
+    double times[kind_count];
+    vec3<> brightness[kind_count];
+    for (int run = 0; run < runs; run++) {
+        for (int k = 0; k < kind_count; k++) {
+            std::clock_t start = std::clock();
+            std::vector<vec3<> > image = render_image(cam, *worlds[k], lights, samples);
+            double t = double(std::clock() - start) / CLOCKS_PER_SEC;
+            times[k] = run == 0 ? t : std::min(times[k], t);
+
+            brightness[k] = vec3<>(0, 0, 0);
+            for (size_t i = 0; i < image.size(); i++) {
+                brightness[k] += image[i];
+            }
+            brightness[k] /= float(image.size());
+        }
+    }
+
+    std::cout << nx << "x" << ny << " at " << samples << " spp, best of " << runs
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (int k = 0; k < kind_count; k++) {
+        std::cout << std::setw(10) << std::left << kinds[k] << std::right
+                  << std::setw(8) << times[k] << "s  ("
+                  << std::setprecision(2) << times[k] / times[0] << "x)"
+                  << "  brightness " << std::setprecision(3)
+                  << (brightness[k].r() + brightness[k].g() + brightness[k].b()) / 3
+                  << std::endl;
+    }
+    return 0;
+}
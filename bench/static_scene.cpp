@@ -0,0 +1,104 @@
+// Compares rendering random_scene() through virtual calls (a bvh_node of
+// hittables with material pointers) against a static_scene holding the same
+// spheres and materials, where the integrator is compiled for the exact
+// types.  Both trees are split the same way and the sampler is deterministic,
+// so the images should come out the same; only the time should differ.
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "bvh.h"
+#include "camera.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "scenes.h"
+#include "static_scene.h"
+
+typedef static_scene<sphere, lambertian, metal, dielectric> random_scene_type;
+
+const int nx = 120;
+const int ny = 80;
+
+template<typename Scene> std::vector<vec3<> >
+render_image(const camera &cam, const Scene &scene, const scene_lights &lights,
+             int samples)
+{
+    std::vector<vec3<> > image(nx * ny);
+    sobol_sampler pixel_sampler(samples);
+    current_sampler() = &pixel_sampler;
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            vec3<> col(0, 0, 0);
+            for (int s = 0; s < samples; s++) {
+                pixel_sampler.start_sample(i, j, s);
+                float du, dv;
+                random_float2(du, dv);
+                ray<float> r = cam.get_ray((i + du) / float(nx), (j + dv) / float(ny));
+                col += trace(r, scene, lights);
+            }
+            image[j*nx + i] = col / float(samples);
+        }
+    }
+    current_sampler() = nullptr;
+    return image;
+}
+
+// CPU seconds for one render, which is less thrown off by other things
+// running on the machine than wall clock time.
+template<typename Scene> double
+time_render(const camera &cam, const Scene &scene, const scene_lights &lights,
+            int samples, std::vector<vec3<> > &image)
+{
+    std::clock_t start = std::clock();
+    image = render_image(cam, scene, lights, samples);
+    return double(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+// usage: static_scene [samples] [runs]
+int main(int argc, char **argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 16;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+
+    hittable_list objects = random_scene();
+    bvh_node virtual_world(objects.objects());
+    random_scene_type static_world;
+    if (!static_world.add(objects.objects())) {
+        return 1;
+    }
+    static_world.build();
+
+    scene_lights lights;
+    camera cam(vec3<>(13, 2, 3), vec3<>(0, 0, 0), vec3<>(0, 1, 0),
+               20, float(nx)/float(ny), 0.1, 10.0);
+
+    // Taking turns, so a slow patch on the machine hits both about the same.
+    std::vector<vec3<> > virtual_image, static_image;
+    double virtual_time = 0, static_time = 0;
+    for (int run = 0; run < runs; run++) {
+        double t = time_render(cam, virtual_scene(&virtual_world), lights, samples,
+                               virtual_image);
+        virtual_time = run == 0 ? t : std::min(virtual_time, t);
+        t = time_render(cam, static_world, lights, samples, static_image);
+        static_time = run == 0 ? t : std::min(static_time, t);
+    }
+
+    size_t different = 0;
+    for (size_t i = 0; i < virtual_image.size(); i++) {
+        if ((virtual_image[i] - static_image[i]).squared_length() > 1e-10) {
+            different++;
+        }
+    }
+
+    std::cout << static_world.size() << " spheres, " << nx << "x" << ny << " at "
+              << samples << " spp, best of " << runs << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(10) << std::left << "virtual" << std::right
+              << std::setw(8) << virtual_time << "s" << std::endl;
+    std::cout << std::setw(10) << std::left << "static" << std::right
+              << std::setw(8) << static_time << "s  ("
+              << std::setprecision(2) << virtual_time / static_time << "x)" << std::endl;
+    std::cout << different << " pixels differ" << std::endl;
+    return different ? 1 : 0;
+}
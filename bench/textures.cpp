@@ -0,0 +1,109 @@
+// Times image_texture lookups from several threads at once, to see how the
+// texture cache holds up when every render thread is fetching texels from
+// it.  Each thread walks its own path across a generated image, with a
+// footprint that sweeps through the mip levels so both bilinear lookups of
+// trilinear filtering happen, and the time is the wall clock for all of them
+// to finish.  With the whole image fitting in the cache every lookup is a
+// hit, so what's left is the cost of finding the tiles.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hittable.h"
+#include "render_workers.h"
+#include "texture.h"
+#include "texture_cache.h"
+
+const int image_size = 1024;
+
+// Smooth stripes, so every tile is different.
+bool
+write_image(const std::string &path)
+{
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out << "P6\n" << image_size << " " << image_size << "\n255\n";
+    std::vector<unsigned char> row(image_size * 3);
+    for (int y = 0; y < image_size; y++) {
+        for (int x = 0; x < image_size; x++) {
+            row[x*3] = (x * 255) / image_size;
+            row[x*3 + 1] = (y * 255) / image_size;
+            row[x*3 + 2] = ((x + y) * 7) & 255;
+        }
+        out.write(reinterpret_cast<const char *>(&row[0]), row.size());
+    }
+    return bool(out);
+}
+
+// usage: textures [lookups per thread, millions] [runs]
+int main(int argc, char **argv)
+{
+    long lookups = long((argc > 1 ? atof(argv[1]) : 2) * 1000000);
+    int runs = argc > 2 ? atoi(argv[2]) : 3;
+
+    const char *tmp = getenv("TMPDIR");
+    std::string directory = std::string(tmp && *tmp ? tmp : "/tmp") + "/textures.XXXXXX";
+    if (!mkdtemp(&directory[0])) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string path = directory + "/stripes.ppm";
+    if (!write_image(path)) {
+        std::cerr << path << ": couldn't write" << std::endl;
+        return 1;
+    }
+
+    texture_cache cache;
+    image_texture image(cache, cache.open(path));
+
+    const unsigned thread_counts[] = {1, 2, 4, 8};
+    const int count = sizeof(thread_counts)/sizeof(*thread_counts);
+    double times[count];
+    for (int run = 0; run < runs; run++) {
+        for (int c = 0; c < count; c++) {
+            render_workers workers(thread_counts[c]);
+            std::vector<float> sums(workers.size());
+            auto job = [&](unsigned worker) {
+                hit_record rec;
+                rec.uv_scale = 1;
+                float sum = 0;
+                for (long i = 0; i < lookups; i++) {
+                    rec.u = float(worker) / workers.size() + i * 1e-5f;
+                    rec.v = 0.5f + 0.4f * sin(i * 3e-5f + worker);
+                    rec.footprint = float(1 + i % 64) / image_size;
+                    sum += image.value(rec).r();
+                }
+                sums[worker] = sum;
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            workers.start(job);
+            workers.wait();
+            double t = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            times[c] = run == 0 ? t : std::min(times[c], t);
+        }
+    }
+
+    std::cout << lookups / 1000000.0 << "M lookups per thread, best of " << runs
+              << ", " << cache.loads() << " tiles loaded" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (int c = 0; c < count; c++) {
+        double rate = thread_counts[c] * lookups / times[c] / 1000000;
+        std::cout << std::setw(2) << thread_counts[c] << " threads "
+                  << std::setw(8) << times[c] << "s  "
+                  << std::setprecision(1) << std::setw(6) << rate << "M lookups/s  ("
+                  << std::setprecision(2) << rate / (lookups / times[0] / 1000000)
+                  << "x)" << std::setprecision(3) << std::endl;
+    }
+
+    unlink(path.c_str());
+    unlink((path + ".mip").c_str());
+    rmdir(directory.c_str());
+    return 0;
+}
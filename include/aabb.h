@@ -0,0 +1,70 @@
+#pragma once
+
+#include <utility>
+
+#include "ray.h"
+
+/* Axis-aligned bounding box, used by the bounding volume hierarchy to skip
+ * whole groups of objects a ray can't possibly hit. */
+class aabb {
+public:
+    aabb() {}
+    aabb(const vec3<float> &a, const vec3<float> &b) : m_min(a), m_max(b) {}
+
+    vec3<float> min() const {return m_min;}
+    vec3<float> max() const {return m_max;}
+    vec3<float> centroid() const {return 0.5f * (m_min + m_max);}
+
+    // Slab test: clip [tmin, tmax] against each pair of axis-aligned planes,
+    // if the interval becomes empty the ray missed the box.
+    bool hit(const ray<float> &r, float tmin, float tmax) const
+    {
+        for (int a = 0; a < 3; a++) {
+            float invD = 1.0f / r.mB[a];
+            float t0 = (m_min[a] - r.mA[a]) * invD;
+            float t1 = (m_max[a] - r.mA[a]) * invD;
+            if (invD < 0.0f) {
+                std::swap(t0, t1);
+            }
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+            if (tmax <= tmin) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Index of the axis this box is longest along.
+    int longest_axis() const
+    {
+        vec3<float> extent = m_max - m_min;
+        if (extent.x() > extent.y() && extent.x() > extent.z()) {
+            return 0;
+        }
+        return extent.y() > extent.z() ? 1 : 2;
+    }
+
+    float surface_area() const
+    {
+        vec3<float> extent = m_max - m_min;
+        return 2 * (extent.x() * extent.y()
+                  + extent.y() * extent.z()
+                  + extent.z() * extent.x());
+    }
+
+    vec3<float> m_min;
+    vec3<float> m_max;
+};
+
+inline aabb
+surrounding_box(const aabb &box0, const aabb &box1)
+{
+    vec3<float> small(fmin(box0.m_min.x(), box1.m_min.x()),
+                      fmin(box0.m_min.y(), box1.m_min.y()),
+                      fmin(box0.m_min.z(), box1.m_min.z()));
+    vec3<float> big(fmax(box0.m_max.x(), box1.m_max.x()),
+                    fmax(box0.m_max.y(), box1.m_max.y()),
+                    fmax(box0.m_max.z(), box1.m_max.z()));
+    return aabb(small, big);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/* Counts heap allocations, for tests that check some code doesn't make any.
+ * Including this replaces the global operator new and delete, so it goes in
+ * the one source file of a test program, and never in another header.
+ *
+ * The replacements are kept out of line.  Inlined into the code they serve,
+ * GCC sees memory from operator new handed to free() and warns about it
+ * (-Wmismatched-new-delete), though that's exactly how they pair up. */
+std::atomic<size_t> heap_allocation_count(0);
+
+// How many allocations there have been so far.
+inline size_t
+heap_allocations()
+{
+    return heap_allocation_count;
+}
+
+__attribute__((noinline)) void *
+operator new(size_t size)
+{
+    heap_allocation_count++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void *
+operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    heap_allocation_count++;
+    return malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) void *
+operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void *
+operator new[](size_t size, const std::nothrow_t &nothrow) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+__attribute__((noinline)) void
+operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void
+operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void
+operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void
+operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "render_workers.h"
+#include "reorder_buffer.h"
+#include "vec3.hpp"
+
+/* Renders frames on render_workers a band of rows at a time, and hands the
+ * bands back to the calling thread in order, top to bottom, as soon as each
+ * band and every band above it are done.  At most 'window' bands are in
+ * memory at a time, so even a huge image only needs a few bands' worth of
+ * pixels.
+ *
+ * The band buffers belong to the renderer, not the frame: they're the
+ * reorder buffer's slots, which keep their capacity from band to band and
+ * frame to frame.  Together with the workers staying around, that means once
+ * a frame of some size has been rendered, rendering more of them doesn't
+ * allocate anything (as long as render_band doesn't). */
+class band_renderer {
+public:
+    band_renderer(render_workers &workers, int band_rows, size_t window) :
+        m_workers(workers),
+        m_band_rows(band_rows),
+        m_bands(window)
+        {}
+
+    // Renders an nx by ny frame.  render_band(first_row, end_row, pixels)
+    // is called on the workers to fill in rows [first_row, end_row), row 0
+    // being the top, nx pixels each.  write_band(pixels) is then called on
+    // this thread with every band in turn.
+    template<typename RenderBand, typename WriteBand>
+    void render(int nx, int ny, RenderBand &render_band, WriteBand &write_band);
+
+    render_workers &workers() {return m_workers;}
+
+private:
+    render_workers &m_workers;
+    int m_band_rows;
+    reorder_buffer<std::vector<vec3<float> > > m_bands;
+};
+
+template<typename RenderBand, typename WriteBand> void
+band_renderer::render(int nx, int ny, RenderBand &render_band, WriteBand &write_band)
+{
+    int band_count = (ny + m_band_rows - 1) / m_band_rows;
+    std::atomic<int> next_band(0);
+
+    auto job = [&](unsigned) {
+        for (int band = next_band++; band < band_count; band = next_band++) {
+            int first_row = band * m_band_rows;
+            int end_row = std::min(first_row + m_band_rows, ny);
+            std::vector<vec3<float> > &pixels = m_bands.acquire(band);
+            pixels.resize((end_row - first_row) * nx);
+            render_band(first_row, end_row, &pixels[0]);
+            m_bands.release(band);
+        }
+    };
+    m_workers.start(job);
+
+    for (int band = 0; band < band_count; band++) {
+        write_band(m_bands.front());
+        m_bands.pop();
+    }
+    m_workers.wait();
+    m_bands.restart();
+}
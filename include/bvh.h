@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "hittable.h"
+#include "hittable_list.h"
+
+/* Bounding volume hierarchy: a binary tree of boxes, so a ray only has to
+ * test the objects whose boxes it actually passes through instead of every
+ * object in the scene.
+ *
+ * Objects without a bounding box (an instance of something empty or
+ * unbounded, say) can't go in the tree.  They're kept to one side in a list
+ * of their own, which every ray is tested against as well. */
+class bvh_node : public hittable {
+public:
+    bvh_node(const std::list<hittable*> &objects)
+    {
+        std::vector<hittable*> v(objects.begin(), objects.end());
+        build(v, 0, v.size());
+    }
+    bvh_node(std::vector<hittable*> objects)
+    {
+        build(objects, 0, objects.size());
+    }
+    bvh_node(std::vector<hittable*> &objects, size_t start, size_t end)
+    {
+        build(objects, start, end);
+    }
+    // For builders that have already decided how to split.  'right' may be
+    // null for a leaf.
+    bvh_node(hittable *left, hittable *right, const aabb &box) :
+        m_left(left),
+        m_right(right),
+        m_box(box),
+        m_unbounded(nullptr)
+        {}
+
+    virtual bool hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const;
+    // An empty node, built from no objects, has no box, and neither does
+    // one holding something unbounded.
+    virtual bool bounding_box(aabb &box) const
+    {
+        box = m_box;
+        return m_left != nullptr && !m_unbounded;
+    }
+
+private:
+    void build(std::vector<hittable*> &objects, size_t start, size_t end);
+
+    // m_right is null for a leaf holding a single object, and both are null
+    // if there are no objects at all.
+    hittable *m_left;
+    hittable *m_right;
+    aabb m_box;
+    // The objects with no box, or null if there aren't any.
+    hittable *m_unbounded;
+};
+
+// Only for objects that have a box: set_aside_unbounded() takes the others
+// out of the way first.
+inline aabb
+object_box(const hittable *object)
+{
+    aabb box;
+    if (!object->bounding_box(box)) {
+        std::cerr << "bvh_node: object has no bounding box" << std::endl;
+        box = aabb(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0));
+    }
+    return box;
+}
+
+// Moves the objects in [start, end) with no bounding box to the end of the
+// range, and returns where they start.  The others stay where they were if
+// there aren't any.
+inline size_t
+set_aside_unbounded(std::vector<hittable*> &objects, size_t start, size_t end)
+{
+    aabb box;
+    return std::partition(objects.begin() + start, objects.begin() + end,
+                          [&box](const hittable *object) {
+        return object->bounding_box(box);
+    }) - objects.begin();
+}
+
+// A list of objects[start, end), or null if that's empty.
+inline hittable *
+unbounded_list(const std::vector<hittable*> &objects, size_t start, size_t end)
+{
+    if (start == end) {
+        return nullptr;
+    }
+    return new hittable_list(std::list<hittable*>(objects.begin() + start,
+                                                  objects.begin() + end));
+}
+
+// Reorders objects[start, end) around a split point and returns it.  The
+// split is along whichever axis the centroids are most spread out on, at the
+// median, so both halves get the same number of objects.
+inline size_t
+split_objects(std::vector<hittable*> &objects, size_t start, size_t end)
+{
+    aabb centroids(object_box(objects[start]).centroid(),
+                   object_box(objects[start]).centroid());
+    for (size_t i = start + 1; i < end; i++) {
+        vec3<float> c = object_box(objects[i]).centroid();
+        centroids = surrounding_box(centroids, aabb(c, c));
+    }
+    int axis = centroids.longest_axis();
+
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(objects.begin() + start, objects.begin() + mid,
+                     objects.begin() + end,
+                     [axis](const hittable *a, const hittable *b) {
+        return object_box(a).centroid()[axis] < object_box(b).centroid()[axis];
+    });
+    return mid;
+}
+
+void
+bvh_node::build(std::vector<hittable*> &objects, size_t start, size_t end)
+{
+    // Only ever finds anything at the root; below that, everything left has
+    // a box.
+    size_t bounded_end = set_aside_unbounded(objects, start, end);
+    m_unbounded = unbounded_list(objects, bounded_end, end);
+    end = bounded_end;
+
+    size_t span = end - start;
+    if (span == 0) {
+        // An empty scene, or only unbounded objects.  Nothing in the tree to
+        // hit, so no box either.
+        m_left = nullptr;
+        m_right = nullptr;
+        return;
+    }
+    if (span == 1) {
+        m_left = objects[start];
+        m_right = nullptr;
+        m_box = object_box(m_left);
+        return;
+    }
+
+    size_t mid = split_objects(objects, start, end);
+    m_left = span == 2 ? objects[start] : new bvh_node(objects, start, mid);
+    m_right = span == 2 ? objects[start + 1] : new bvh_node(objects, mid, end);
+    m_box = surrounding_box(object_box(m_left), object_box(m_right));
+}
+
+bool
+bvh_node::hit(const ray<float> &r, float t_min, float t_max,
+              hit_record &rec) const
+{
+    bool hit_unbounded = m_unbounded && m_unbounded->hit(r, t_min, t_max, rec);
+    if (hit_unbounded) {
+        t_max = rec.t;
+    }
+    if (!m_left || !m_box.hit(r, t_min, t_max)) {
+        return hit_unbounded;
+    }
+
+    bool hit_left = m_left->hit(r, t_min, t_max, rec);
+    if (!m_right) {
+        return hit_left || hit_unbounded;
+    }
+    // Only accept something from the right side if it's closer.
+    bool hit_right = m_right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    return hit_left || hit_right || hit_unbounded;
+}
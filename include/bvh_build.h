@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <list>
+#include <vector>
+
+#include "bvh.h"
+
+/* Multi-threaded bvh_node builder using the binned surface area heuristic.
+ *
+ * Instead of always splitting at the median, every range is split where the
+ * expected cost of tracing a ray through the two halves is lowest: a child's
+ * chance of being hit is proportional to its surface area, so the cost of a
+ * split is area(left) * count(left) + area(right) * count(right).  Rather
+ * than trying every possible split, centroids are dropped into a few bins
+ * along each axis and only the bin boundaries are tried.
+ *
+ * The two halves of a split are independent, so the left one is handed to
+ * another thread while this one carries on with the right, until the thread
+ * budget runs out.  Near the root there are only one or two ranges to work
+ * on, so big ranges also do their bounds and binning passes in parallel
+ * chunks. */
+class bvh_builder {
+public:
+    static const int bins = 12;
+    // Smaller ranges than this are built on the current thread.
+    static const size_t parallel_threshold = 4096;
+    // Ranges at least this big also split their binning passes across threads.
+    static const size_t parallel_chunk_threshold = 1 << 16;
+
+    bvh_builder(unsigned threads) : m_threads(threads ? threads : 1) {}
+
+    // Returns the root of the new hierarchy: a bvh_node, or the object itself
+    // if there's only one.  Objects with no bounding box are left out of the
+    // tree, and the root is then a hittable_list of them and the tree.
+    hittable *build(const std::vector<hittable*> &objects);
+
+private:
+    // Everything the builder needs to know about an object, so the virtual
+    // bounding_box() is only called once per object.
+    struct build_ref {
+        aabb box;
+        vec3<float> centroid;
+        hittable *object;
+    };
+
+    struct range_bounds {
+        aabb box;
+        aabb centroids;
+    };
+
+    struct bin {
+        aabb box;
+        size_t count;
+    };
+
+    struct bin_set {
+        bin b[3][bins];
+    };
+
+    hittable *build_range(size_t start, size_t end, unsigned threads);
+    range_bounds find_bounds(size_t start, size_t end, unsigned threads) const;
+    size_t split_range(size_t start, size_t end, const range_bounds &bounds,
+                       unsigned threads);
+
+    // Calls f(chunk_start, chunk_end, chunk) for 'threads' chunks of
+    // [start, end), in parallel.
+    template<typename F> static void
+    for_chunks(size_t start, size_t end, unsigned threads, F f)
+    {
+        size_t chunk_size = (end - start + threads - 1) / threads;
+        std::vector<std::future<void> > futures;
+        for (unsigned chunk = 1; chunk < threads; chunk++) {
+            size_t chunk_start = std::min(end, start + chunk * chunk_size);
+            size_t chunk_end = std::min(end, chunk_start + chunk_size);
+            futures.push_back(std::async(std::launch::async, f,
+                                         chunk_start, chunk_end, chunk));
+        }
+        f(start, std::min(end, start + chunk_size), 0u);
+        for (auto it = futures.begin(); it != futures.end(); it++) {
+            it->get();
+        }
+    }
+
+    unsigned m_threads;
+    std::vector<build_ref> m_refs;
+};
+
+hittable *
+bvh_builder::build(const std::vector<hittable*> &objects)
+{
+    if (objects.empty()) {
+        // An empty node, which nothing hits.
+        return new bvh_node(objects);
+    }
+
+    m_refs.resize(objects.size());
+    std::vector<char> bounded(objects.size());
+    unsigned threads = objects.size() >= parallel_chunk_threshold ? m_threads : 1;
+    for_chunks(0, objects.size(), threads,
+               [this, &objects, &bounded](size_t start, size_t end, unsigned) {
+        for (size_t i = start; i < end; i++) {
+            m_refs[i].object = objects[i];
+            bounded[i] = objects[i]->bounding_box(m_refs[i].box);
+            if (bounded[i]) {
+                m_refs[i].centroid = m_refs[i].box.centroid();
+            }
+        }
+    });
+
+    // Take out the objects with no box, keeping the rest in order.
+    std::list<hittable*> unbounded;
+    size_t kept = 0;
+    for (size_t i = 0; i < m_refs.size(); i++) {
+        if (bounded[i]) {
+            m_refs[kept++] = m_refs[i];
+        } else {
+            unbounded.push_back(m_refs[i].object);
+        }
+    }
+    m_refs.resize(kept);
+
+    hittable *root = m_refs.empty() ? nullptr : build_range(0, m_refs.size(), m_threads);
+    m_refs.clear();
+    if (unbounded.empty()) {
+        return root;
+    }
+    if (root) {
+        unbounded.push_front(root);
+    }
+    return new hittable_list(unbounded);
+}
+
+hittable *
+bvh_builder::build_range(size_t start, size_t end, unsigned threads)
+{
+    size_t span = end - start;
+    if (span == 1) {
+        return m_refs[start].object;
+    }
+
+    range_bounds bounds = find_bounds(start, end, threads);
+    if (span == 2) {
+        return new bvh_node(m_refs[start].object, m_refs[start + 1].object,
+                            bounds.box);
+    }
+
+    size_t mid = split_range(start, end, bounds, threads);
+
+    hittable *left;
+    hittable *right;
+    if (threads > 1 && span >= parallel_threshold) {
+        unsigned left_threads = threads / 2;
+        auto future_left = std::async(std::launch::async,
+                                      &bvh_builder::build_range, this,
+                                      start, mid, left_threads);
+        right = build_range(mid, end, threads - left_threads);
+        left = future_left.get();
+    } else {
+        left = build_range(start, mid, 1);
+        right = build_range(mid, end, 1);
+    }
+    return new bvh_node(left, right, bounds.box);
+}
+
+bvh_builder::range_bounds
+bvh_builder::find_bounds(size_t start, size_t end, unsigned threads) const
+{
+    if (end - start < parallel_chunk_threshold) {
+        threads = 1;
+    }
+
+    std::vector<range_bounds> partial(threads);
+    std::vector<char> used(threads, false);
+    for_chunks(start, end, threads,
+               [this, &partial, &used](size_t s, size_t e, unsigned chunk) {
+        if (s >= e) {
+            return;
+        }
+        range_bounds &b = partial[chunk];
+        b.box = m_refs[s].box;
+        b.centroids = aabb(m_refs[s].centroid, m_refs[s].centroid);
+        for (size_t i = s + 1; i < e; i++) {
+            b.box = surrounding_box(b.box, m_refs[i].box);
+            b.centroids = surrounding_box(b.centroids,
+                                          aabb(m_refs[i].centroid, m_refs[i].centroid));
+        }
+        used[chunk] = true;
+    });
+
+    // Chunk 0 is never empty, so it can seed the merge.
+    range_bounds out = partial[0];
+    for (unsigned chunk = 1; chunk < threads; chunk++) {
+        if (used[chunk]) {
+            out.box = surrounding_box(out.box, partial[chunk].box);
+            out.centroids = surrounding_box(out.centroids, partial[chunk].centroids);
+        }
+    }
+    return out;
+}
+
+size_t
+bvh_builder::split_range(size_t start, size_t end, const range_bounds &bounds,
+                         unsigned threads)
+{
+    vec3<float> cmin = bounds.centroids.m_min;
+    vec3<float> extent = bounds.centroids.m_max - cmin;
+    size_t median = start + (end - start) / 2;
+
+    // Every centroid in the same spot: any split is as good as another.
+    if (extent.x() <= 0 && extent.y() <= 0 && extent.z() <= 0) {
+        return median;
+    }
+
+    auto bin_of = [cmin, extent](const vec3<float> &c, int axis) {
+        int b = int(bins * (c[axis] - cmin[axis]) / extent[axis]);
+        return b < bins ? b : bins - 1;
+    };
+
+    // Fill the bins, per chunk, then merge them.
+    if (end - start < parallel_chunk_threshold) {
+        threads = 1;
+    }
+    std::vector<bin_set> partial(threads);
+    for_chunks(start, end, threads,
+               [this, &partial, &bin_of, extent](size_t s, size_t e, unsigned chunk) {
+        bin_set &set = partial[chunk];
+        for (int axis = 0; axis < 3; axis++) {
+            for (int b = 0; b < bins; b++) {
+                set.b[axis][b].count = 0;
+            }
+        }
+        for (size_t i = s; i < e; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                if (extent[axis] <= 0) {
+                    continue;
+                }
+                bin &slot = set.b[axis][bin_of(m_refs[i].centroid, axis)];
+                slot.box = slot.count ? surrounding_box(slot.box, m_refs[i].box)
+                                      : m_refs[i].box;
+                slot.count++;
+            }
+        }
+    });
+    bin_set merged = partial[0];
+    for (unsigned chunk = 1; chunk < threads; chunk++) {
+        for (int axis = 0; axis < 3; axis++) {
+            for (int b = 0; b < bins; b++) {
+                bin &into = merged.b[axis][b];
+                const bin &from = partial[chunk].b[axis][b];
+                if (!from.count) {
+                    continue;
+                }
+                into.box = into.count ? surrounding_box(into.box, from.box) : from.box;
+                into.count += from.count;
+            }
+        }
+    }
+
+    // Sweep from the right to get the cost of everything past each
+    // boundary, then from the left to find the cheapest boundary.
+    float best_cost = -1;
+    int best_axis = 0;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0) {
+            continue;
+        }
+        const bin *row = merged.b[axis];
+        float right_cost[bins];
+        aabb box;
+        size_t count = 0;
+        for (int b = bins - 1; b > 0; b--) {
+            if (row[b].count) {
+                box = count ? surrounding_box(box, row[b].box) : row[b].box;
+                count += row[b].count;
+            }
+            right_cost[b] = count ? box.surface_area() * count : -1;
+        }
+        count = 0;
+        for (int b = 0; b < bins - 1; b++) {
+            if (row[b].count) {
+                box = count ? surrounding_box(box, row[b].box) : row[b].box;
+                count += row[b].count;
+            }
+            // Splits that leave one side empty aren't splits.
+            if (!count || right_cost[b + 1] < 0) {
+                continue;
+            }
+            float cost = box.surface_area() * count + right_cost[b + 1];
+            if (best_cost < 0 || cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    if (best_cost < 0) {
+        return median;
+    }
+
+    auto mid = std::partition(m_refs.begin() + start, m_refs.begin() + end,
+                              [&bin_of, best_axis, best_split](const build_ref &ref) {
+        return bin_of(ref.centroid, best_axis) < best_split;
+    });
+    return mid - m_refs.begin();
+}
+
+// Convenience wrapper: build a hierarchy over 'objects' with 'threads' threads.
+inline hittable *
+build_bvh(const std::vector<hittable*> &objects, unsigned threads)
+{
+    bvh_builder builder(threads);
+    return builder.build(objects);
+}
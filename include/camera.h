@@ -12,6 +12,7 @@ public:
     {
         float theta = vfov*M_PI/180;
         float half_height = tan(theta/2); // Works because z = -1
+        m_vfov = theta;
         float half_width = aspect_ratio * half_height;
 
         // Is vector representing a ray from 'lookfrom' to 'lookat'.  It's at
@@ -58,10 +59,18 @@ public:
         return r;
     }
     
+    // Angle one pixel covers, top to bottom, in an image 'ny' pixels high:
+    // how fast the footprint of a camera ray grows with distance.
+    float pixel_spread(int ny) const
+    {
+        return m_vfov / ny;
+    }
+
     vec3<float> m_lower_left_corner;
     vec3<float> m_horizontal;
     vec3<float> m_vertical;
     vec3<float> m_origin;
     vec3<float> u, v, w;
     float m_lens_radius;
+    float m_vfov;
 };
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Render settings that used to be preprocessor macros, read at run time from
+ * the command line and/or a config file so trying a different configuration
+ * doesn't need a rebuild.
+ *
+ * Every setting has a key; on the command line it's "--key value" (or
+ * "--key=value"), in a config file it's a "key = value" line, and '#' starts a
+ * comment.  Command line settings are applied in order, so anything after
+ * "--config file" overrides the file. */
+struct render_config {
+    render_config() :
+        width(1600),
+        height(0),
+        samples(100),
+        max_depth(50),
+        threads(0),
+        tile_size(16),
+        window(0),
+        antialias(true),
+        denoise(false),
+        nee(true),
+        format("ppm-ascii"),
+        output("-"),
+        scene("random"),
+        sampler("random"),
+        bvh("eager"),
+        texture_cache_mb(64),
+        fog("medium")
+        {}
+
+    // Sets one setting from its text form.  Returns false, after saying why
+    // on stderr, if the key or value is no good.
+    bool set(const std::string &key, const std::string &value);
+
+    // Defaults to the 3:2 aspect ratio of the final scene.
+    float aspect_ratio() const
+    {
+        return height > 0 ? float(width) / height : 3.0f / 2.0f;
+    }
+
+    // At least 1, however narrow the width.
+    int image_height() const
+    {
+        return height > 0 ? height : std::max(1, int(width / aspect_ratio()));
+    }
+
+    int window_size() const
+    {
+        return window > 0 ? window : 2 * thread_count();
+    }
+
+    unsigned thread_count() const
+    {
+        if (threads > 0) {
+            return threads;
+        }
+        unsigned hardware = std::thread::hardware_concurrency();
+        return hardware ? hardware : 1;
+    }
+
+    int width;
+    // 0 picks one from the width.
+    int height;
+    int samples;
+    int max_depth;
+    // 0 uses every core.
+    int threads;
+    // Rows of the image handed to a thread at a time.
+    int tile_size;
+    // How many of those bands can be rendered or waiting to be written at
+    // once, which is what bounds memory use.  0 picks twice the threads.
+    int window;
+    bool antialias;
+    bool denoise;
+    // Sample the scene's lights directly (next event estimation).
+    bool nee;
+    // "ppm-ascii" (P3) or "ppm" (binary P6).
+    std::string format;
+    // File to write the image to, "-" for stdout.
+    std::string output;
+    // random, instanced, lights, refraction, spheres, textures or fog.
+    std::string scene;
+    // random, stratified, halton or sobol.
+    std::string sampler;
+    // none, eager or lazy.
+    std::string bvh;
+    // Image files for the textures scene.
+    std::vector<std::string> textures;
+    // Memory for the tiles of those images.
+    int texture_cache_mb;
+    // How the fog scene makes its fog: medium, bubbles or none.
+    std::string fog;
+};
+
+inline void
+print_usage(std::ostream &out, const char *program)
+{
+    render_config d;
+    out << "usage: " << program << " [--key value]...\n"
+        << "  --config FILE      read key = value settings from FILE\n"
+        << "  --width N          image width (" << d.width << ")\n"
+        << "  --height N         image height (width / 1.5)\n"
+        << "  --scale N          width = N * 200, like the old SCALE macro\n"
+        << "  --samples N        samples per pixel (" << d.samples << ")\n"
+        << "  --depth N          maximum bounces (" << d.max_depth << ")\n"
+        << "  --threads N        render threads (all cores)\n"
+        << "  --tile N           rows per work unit (" << d.tile_size << ")\n"
+        << "  --window N         work units in memory at once (2 * threads)\n"
+        << "  --antialias 0|1    jitter samples within a pixel (" << d.antialias << ")\n"
+        << "  --denoise 0|1      denoise before writing (" << d.denoise << ")\n"
+        << "  --nee 0|1          sample lights directly (" << d.nee << ")\n"
+        << "  --format F         ppm-ascii or ppm (" << d.format << ")\n"
+        << "  --output FILE      where to write the image, - for stdout\n"
+        << "  --scene S          random, instanced, lights, refraction, spheres,\n"
+        << "                     textures or fog\n"
+        << "  --textures A,B...  binary PPM images for the textures scene\n"
+        << "  --texture-cache N  megabytes of image tiles to keep (" << d.texture_cache_mb << ")\n"
+        << "  --fog F            medium, bubbles or none, for the fog scene (" << d.fog << ")\n"
+        << "  --sampler S        random, stratified, halton or sobol\n"
+        << "  --bvh B            none, eager or lazy (" << d.bvh << ")\n";
+}
+
+// Widest or tallest image there can be.  Pixel counts are ints, three
+// channels each, and this keeps those from overflowing.
+const int max_image_size = 16384;
+
+inline bool
+parse_int(const std::string &key, const std::string &value, int &out, int min,
+          int max = INT_MAX)
+{
+    std::istringstream in(value);
+    int parsed;
+    if (!(in >> parsed) || !in.eof() || parsed < min || parsed > max) {
+        std::cerr << key << ": expected a number >= " << min;
+        if (max != INT_MAX) {
+            std::cerr << " and <= " << max;
+        }
+        std::cerr << ", not '" << value << "'" << std::endl;
+        return false;
+    }
+    out = parsed;
+    return true;
+}
+
+inline bool
+parse_bool(const std::string &key, const std::string &value, bool &out)
+{
+    if (value == "1" || value == "true" || value == "yes" || value == "on") {
+        out = true;
+    } else if (value == "0" || value == "false" || value == "no" || value == "off") {
+        out = false;
+    } else {
+        std::cerr << key << ": expected 0 or 1, not '" << value << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Checks 'value' is one of the space separated words in 'choices'.
+inline bool
+parse_choice(const std::string &key, const std::string &value,
+             const std::string &choices, std::string &out)
+{
+    std::istringstream in(choices);
+    std::string choice;
+    while (in >> choice) {
+        if (choice == value) {
+            out = value;
+            return true;
+        }
+    }
+    std::cerr << key << ": expected one of " << choices << ", not '" << value
+              << "'" << std::endl;
+    return false;
+}
+
+bool load_config_file(const std::string &path, render_config &config);
+
+bool
+render_config::set(const std::string &key, const std::string &value)
+{
+    if (key == "width") return parse_int(key, value, width, 1, max_image_size);
+    if (key == "height") return parse_int(key, value, height, 0, max_image_size);
+    if (key == "scale") {
+        int scale;
+        if (!parse_int(key, value, scale, 1, max_image_size / 200)) {
+            return false;
+        }
+        width = scale * 200;
+        return true;
+    }
+    if (key == "samples") return parse_int(key, value, samples, 1);
+    if (key == "depth") return parse_int(key, value, max_depth, 0);
+    if (key == "threads") return parse_int(key, value, threads, 0);
+    if (key == "tile") return parse_int(key, value, tile_size, 1);
+    if (key == "window") return parse_int(key, value, window, 0);
+    if (key == "antialias") return parse_bool(key, value, antialias);
+    if (key == "denoise") return parse_bool(key, value, denoise);
+    if (key == "nee") return parse_bool(key, value, nee);
+    if (key == "format") return parse_choice(key, value, "ppm-ascii ppm", format);
+    if (key == "output") {
+        output = value;
+        return true;
+    }
+    if (key == "scene") {
+        return parse_choice(key, value,
+                            "random instanced lights refraction spheres textures fog",
+                            scene);
+    }
+    if (key == "sampler") {
+        return parse_choice(key, value, "random stratified halton sobol", sampler);
+    }
+    if (key == "bvh") return parse_choice(key, value, "none eager lazy", bvh);
+    if (key == "fog") return parse_choice(key, value, "medium bubbles none", fog);
+    if (key == "textures") {
+        textures.clear();
+        std::istringstream in(value);
+        std::string path;
+        while (std::getline(in, path, ',')) {
+            if (!path.empty()) {
+                textures.push_back(path);
+            }
+        }
+        return true;
+    }
+    if (key == "texture-cache") return parse_int(key, value, texture_cache_mb, 1);
+    if (key == "config") return load_config_file(value, *this);
+
+    std::cerr << "unknown setting '" << key << "'" << std::endl;
+    return false;
+}
+
+inline std::string
+trim(const std::string &s)
+{
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+// Reads the settings in 'path' into 'config'.  Doesn't guard against files
+// including themselves; load_config_file() does that.
+inline bool
+read_config_file(const std::string &path, std::istream &in, render_config &config)
+{
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << path << ":" << number << ": expected key = value" << std::endl;
+            return false;
+        }
+        if (!config.set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+            std::cerr << path << ":" << number << ": bad setting" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+load_config_file(const std::string &path, render_config &config)
+{
+    std::ifstream in(path.c_str());
+    if (!in) {
+        std::cerr << path << ": can't open config file" << std::endl;
+        return false;
+    }
+
+    // The files being read right now, outermost first, so a "config = FILE"
+    // line that leads back to one of them is an error instead of endless
+    // recursion.  Compared by real path, so different spellings of the same
+    // file count as the same.
+    static std::vector<std::string> loading;
+    char resolved[PATH_MAX];
+    std::string real_path = realpath(path.c_str(), resolved) ? resolved : path;
+    if (std::find(loading.begin(), loading.end(), real_path) != loading.end()) {
+        std::cerr << path << ": config file includes itself" << std::endl;
+        return false;
+    }
+
+    loading.push_back(real_path);
+    bool ok = read_config_file(path, in, config);
+    loading.pop_back();
+    return ok;
+}
+
+// What parse_args() made of the command line.
+enum args_result {
+    args_ok,
+    // --help was asked for, and the usage has been printed.
+    args_help,
+    // Something was wrong with it, and that's been said on stderr.
+    args_error
+};
+
+// Applies the command line to 'config'.
+inline args_result
+parse_args(int argc, char **argv, render_config &config)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(std::cout, argv[0]);
+            return args_help;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            std::cerr << "unexpected argument '" << arg << "'" << std::endl;
+            print_usage(std::cerr, argv[0]);
+            return args_error;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        size_t eq = key.find('=');
+        if (eq != std::string::npos) {
+            value = key.substr(eq + 1);
+            key = key.substr(0, eq);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            std::cerr << "--" << key << " needs a value" << std::endl;
+            return args_error;
+        }
+
+        if (!config.set(key, value)) {
+            print_usage(std::cerr, argv[0]);
+            return args_error;
+        }
+    }
+    return args_ok;
+}
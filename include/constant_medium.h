@@ -0,0 +1,79 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "hittable.h"
+#include "material.h"
+#include "sampler.h"
+
+/* Smoke or fog of the same density throughout the inside of 'boundary'.
+ * Instead of bouncing off a surface, a ray going through it may scatter at
+ * any point along the way: the chance of getting a distance d further
+ * without scattering is exp(-density * d), so where it scatters can be drawn
+ * directly from one random number.  What happens when it does is up to the
+ * phase function, normally an isotropic material.
+ *
+ * The boundary has to be convex (a sphere), since only the first stretch of
+ * the ray inside it counts.  Works as a light blocker too: a ray towards a
+ * light that scatters in the fog never gets there. */
+class constant_medium : public hittable {
+public:
+    constant_medium(hittable *boundary, float density, material *phase_function) :
+        m_boundary(boundary),
+        m_neg_inv_density(-1 / density),
+        m_phase_function(phase_function)
+        {}
+
+    virtual bool hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const;
+    virtual bool bounding_box(aabb &box) const
+    {
+        return m_boundary->bounding_box(box);
+    }
+
+private:
+    hittable *m_boundary;
+    float m_neg_inv_density;
+    material *m_phase_function;
+};
+
+bool
+constant_medium::hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const
+{
+    // Where the whole line goes in and out of the boundary, so rays that
+    // start inside it are handled too.
+    hit_record enter, leave;
+    if (!m_boundary->hit(r, -FLT_MAX, FLT_MAX, enter)
+        || !m_boundary->hit(r, enter.t + 0.0001f, FLT_MAX, leave)) {
+        return false;
+    }
+
+    float t_enter = std::max(enter.t, t_min);
+    float t_leave = std::min(leave.t, t_max);
+    if (t_enter >= t_leave) {
+        return false;
+    }
+
+    float length = r.direction().length();
+    float inside = (t_leave - t_enter) * length;
+    // 1 - u so it's never log(0).
+    float distance = m_neg_inv_density * log(1 - random_float());
+    if (distance > inside) {
+        return false;
+    }
+
+    rec.t = t_enter + distance / length;
+    rec.p = r.point_at_parameter(rec.t);
+    // There's no surface, so no real normal or surface coordinates.  Facing
+    // back along the ray is what the denoiser would expect to see.
+    rec.normal = -r.direction() / length;
+    rec.mat_ptr = m_phase_function;
+    rec.u = 0;
+    rec.v = 0;
+    rec.uv_scale = 0;
+    return true;
+}
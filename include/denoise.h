@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "vec3.hpp"
+
+/* What the first thing hit in a pixel looked like, averaged over the pixel's
+ * samples.  These are nearly noise free even at a few samples per pixel, so
+ * the denoiser uses them to tell real edges from noise. */
+struct pixel_features {
+    pixel_features() : albedo(0, 0, 0), normal(0, 0, 0), depth(0) {}
+
+    vec3<float> albedo;
+    vec3<float> normal;
+    float depth;
+};
+
+/* Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010).
+ *
+ * Each pass blurs with a 5x5 B3-spline kernel whose taps are spread 1, 2, 4,
+ * 8... pixels apart, so a few passes cover a wide area at 25 taps per pixel
+ * each.  A tap's weight is cut down when its color, normal, depth or albedo is
+ * too different from the center pixel, which keeps the blur from crossing
+ * edges.  The color threshold halves every pass since there's less noise left
+ * to remove.
+ *
+ * Colors are divided by albedo before filtering and multiplied back after, so
+ * surface detail comes from the (noise free) albedo and only the lighting gets
+ * blurred.
+ *
+ * The image is split into tiles that worker threads take turns on; passes
+ * run one after another since each reads the previous one's output. */
+class atrous_denoiser {
+public:
+    atrous_denoiser(unsigned threads = 0) :
+        m_iterations(5),
+        m_sigma_color(0.1),
+        m_sigma_normal(0.1),
+        m_sigma_depth(0.05),
+        m_sigma_albedo(0.1),
+        m_tile_size(64),
+        m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+        {}
+
+    // 'image' is linear (not gamma corrected) color, nx * ny pixels in rows,
+    // and is filtered in place.
+    void denoise(std::vector<vec3<float> > &image,
+                 const std::vector<pixel_features> &features, int nx, int ny) const;
+
+    int m_iterations;
+    // How different two pixels can be before they stop being blurred together:
+    // color distance (squared), 1 - cos of the angle between normals, depth
+    // difference relative to the center's depth, and albedo distance (squared).
+    float m_sigma_color;
+    float m_sigma_normal;
+    float m_sigma_depth;
+    float m_sigma_albedo;
+    int m_tile_size;
+    unsigned m_threads;
+
+private:
+    void filter_tile(const std::vector<vec3<float> > &in,
+                     std::vector<vec3<float> > &out,
+                     const std::vector<pixel_features> &features,
+                     int nx, int ny, int tile_x, int tile_y,
+                     int step, float sigma_color) const;
+};
+
+// Keeps the division from blowing up on black surfaces.
+inline vec3<float>
+demodulation_albedo(const pixel_features &f)
+{
+    const float min_albedo = 0.01f;
+    return vec3<float>(std::max(f.albedo.x(), min_albedo),
+                       std::max(f.albedo.y(), min_albedo),
+                       std::max(f.albedo.z(), min_albedo));
+}
+
+void
+atrous_denoiser::denoise(std::vector<vec3<float> > &image,
+                         const std::vector<pixel_features> &features,
+                         int nx, int ny) const
+{
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] /= demodulation_albedo(features[i]);
+    }
+
+    int tiles_x = (nx + m_tile_size - 1) / m_tile_size;
+    int tiles_y = (ny + m_tile_size - 1) / m_tile_size;
+    int tile_count = tiles_x * tiles_y;
+
+    std::vector<vec3<float> > scratch(image.size());
+    std::vector<vec3<float> > *in = &image;
+    std::vector<vec3<float> > *out = &scratch;
+    float sigma_color = m_sigma_color;
+    for (int pass = 0; pass < m_iterations; pass++) {
+        int step = 1 << pass;
+        std::atomic<int> next_tile(0);
+        auto worker = [&, step, sigma_color]() {
+            for (int tile = next_tile++; tile < tile_count; tile = next_tile++) {
+                filter_tile(*in, *out, features, nx, ny,
+                            (tile % tiles_x) * m_tile_size,
+                            (tile / tiles_x) * m_tile_size,
+                            step, sigma_color);
+            }
+        };
+
+        std::vector<std::future<void> > workers;
+        for (unsigned t = 1; t < m_threads; t++) {
+            workers.push_back(std::async(std::launch::async, worker));
+        }
+        worker();
+        for (auto it = workers.begin(); it != workers.end(); it++) {
+            it->get();
+        }
+
+        std::swap(in, out);
+        sigma_color /= 2;
+    }
+    if (in != &image) {
+        image.swap(*in);
+    }
+
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] *= demodulation_albedo(features[i]);
+    }
+}
+
+void
+atrous_denoiser::filter_tile(const std::vector<vec3<float> > &in,
+                             std::vector<vec3<float> > &out,
+                             const std::vector<pixel_features> &features,
+                             int nx, int ny, int tile_x, int tile_y,
+                             int step, float sigma_color) const
+{
+    static const float kernel[5] = {1/16.0f, 1/4.0f, 3/8.0f, 1/4.0f, 1/16.0f};
+
+    int end_x = std::min(tile_x + m_tile_size, nx);
+    int end_y = std::min(tile_y + m_tile_size, ny);
+    for (int y = tile_y; y < end_y; y++) {
+        for (int x = tile_x; x < end_x; x++) {
+            const vec3<float> &center = in[y*nx + x];
+            const pixel_features &f = features[y*nx + x];
+
+            vec3<float> sum(0, 0, 0);
+            float weight_sum = 0;
+            for (int dy = -2; dy <= 2; dy++) {
+                int qy = y + dy * step;
+                if (qy < 0 || qy >= ny) {
+                    continue;
+                }
+                for (int dx = -2; dx <= 2; dx++) {
+                    int qx = x + dx * step;
+                    if (qx < 0 || qx >= nx) {
+                        continue;
+                    }
+                    const vec3<float> &c = in[qy*nx + qx];
+                    const pixel_features &g = features[qy*nx + qx];
+
+                    float color_distance = (c - center).squared_length() / sigma_color;
+                    float normal_distance = std::max(0.0f, 1 - dot(f.normal, g.normal))
+                                          / m_sigma_normal;
+                    float depth_distance = fabs(f.depth - g.depth)
+                                         / (m_sigma_depth * std::max(f.depth, 1e-3f));
+                    float albedo_distance = (f.albedo - g.albedo).squared_length()
+                                          / m_sigma_albedo;
+                    float w = kernel[dx + 2] * kernel[dy + 2]
+                            * exp(-(color_distance + normal_distance
+                                    + depth_distance + albedo_distance));
+                    sum += w * c;
+                    weight_sum += w;
+                }
+            }
+            // The center tap always has weight, so this is never zero.
+            out[y*nx + x] = sum / weight_sum;
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "aabb.h"
 #include "ray.h"
 
 class material;
@@ -12,10 +13,40 @@ struct hit_record {
     // vector from the origin.
     vec3<float> normal;
     material *mat_ptr;
+    // Surface coordinates in [0,1), for textures.
+    float u;
+    float v;
+    // How far (u, v) move per unit of distance along the surface, so a
+    // texture can tell how much of itself a ray's footprint covers.
+    float uv_scale;
+    // Width of the ray's footprint where it hit, filled in by the integrator.
+    float footprint;
+
+    // Size of the footprint in (u, v) units.
+    float uv_width() const {return footprint * uv_scale;}
 };
 
 class hittable {
 public:
+    // Fills in 'rec' if 'r' hits the object between t_min and t_max.  'rec'
+    // must be left alone on a miss, so containers can pass the same record
+    // down to everything in them and keep the closest hit.
     virtual bool hit(const ray<float> &r, float t_min, float t_max,
                      hit_record &rec) const = 0;
+    // Box that encloses the whole object, used to build acceleration
+    // structures.  Returns false if the object is unbounded.
+    virtual bool bounding_box(aabb &box) const = 0;
+
+    // For objects that can be used as lights: the probability density (per
+    // solid angle, seen from 'origin') of random() picking 'direction'...
+    virtual float pdf_value(const vec3<float> &origin,
+                            const vec3<float> &direction) const
+    {
+        return 0;
+    }
+    // ...and a random direction from 'origin' towards the object.
+    virtual vec3<float> random(const vec3<float> &origin) const
+    {
+        return vec3<float>(1, 0, 0);
+    }
 };
@@ -18,6 +18,8 @@ public:
     : mList(l) {}
     virtual bool hit(const ray<float> &r, float t_min, float t_max,
                      hit_record &rec) const;
+    virtual bool bounding_box(aabb &box) const;
+    const std::list<hittable*> &objects() const {return mList;}
 private:
     std::list<hittable*> mList;
     int mListSize;
@@ -25,15 +27,28 @@ private:
 
 bool hittable_list::hit(const ray<float> &r, float t_min, float t_max,
                    hit_record &rec) const {
-    hit_record temp_rec;
+    // Straight into 'rec', without a copy per hit: an object only fills it in
+    // if it's closer than everything before it, and leaves it alone if not.
     bool hit_anything = false;
     float closest_so_far = t_max;
     for(auto it = mList.begin(); it != mList.end(); it++) {
-        if((*it)->hit(r, t_min, closest_so_far, temp_rec)) {
+        if((*it)->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
     return hit_anything;
 }
+
+bool hittable_list::bounding_box(aabb &box) const {
+    bool first = true;
+    aabb temp_box;
+    for(auto it = mList.begin(); it != mList.end(); it++) {
+        if (!(*it)->bounding_box(temp_box)) {
+            return false;
+        }
+        box = first ? temp_box : surrounding_box(box, temp_box);
+        first = false;
+    }
+    return !first;
+}
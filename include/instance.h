@@ -0,0 +1,145 @@
+#pragma once
+
+#include "hittable.h"
+#include "mat3.hpp"
+
+/* Affine transform: a linear part (rotation and scale) followed by a
+ * translation. */
+class transform {
+public:
+    transform() :
+        m_linear(mat3<float>::identity()),
+        m_translation(0, 0, 0)
+        {}
+    transform(const mat3<float> &linear, const vec3<float> &translation) :
+        m_linear(linear),
+        m_translation(translation)
+        {}
+
+    static transform translate(const vec3<float> &offset)
+    {
+        return transform(mat3<float>::identity(), offset);
+    }
+
+    static transform scale(float s)
+    {
+        return scale(vec3<float>(s, s, s));
+    }
+
+    static transform scale(const vec3<float> &s)
+    {
+        return transform(mat3<float>::diagonal(s), vec3<float>(0, 0, 0));
+    }
+
+    // Rodrigues' rotation formula, counter-clockwise around 'axis'.
+    static transform rotate(const vec3<float> &axis, float degrees)
+    {
+        vec3<float> a = unit_vector(axis);
+        float theta = degrees*M_PI/180;
+        float c = cos(theta);
+        float s = sin(theta);
+        float t = 1 - c;
+        mat3<float> r(
+            vec3<float>(t*a.x()*a.x() + c,       t*a.x()*a.y() - s*a.z(), t*a.x()*a.z() + s*a.y()),
+            vec3<float>(t*a.x()*a.y() + s*a.z(), t*a.y()*a.y() + c,       t*a.y()*a.z() - s*a.x()),
+            vec3<float>(t*a.x()*a.z() - s*a.y(), t*a.y()*a.z() + s*a.x(), t*a.z()*a.z() + c));
+        return transform(r, vec3<float>(0, 0, 0));
+    }
+
+    vec3<float> apply_point(const vec3<float> &p) const
+    {
+        return m_linear * p + m_translation;
+    }
+
+    vec3<float> apply_vector(const vec3<float> &v) const
+    {
+        return m_linear * v;
+    }
+
+    transform inverse() const
+    {
+        mat3<float> inv = m_linear.inverse();
+        return transform(inv, -(inv * m_translation));
+    }
+
+    mat3<float> m_linear;
+    vec3<float> m_translation;
+};
+
+// Composition: (a * b) applies b first, then a.
+inline transform
+operator*(const transform &a, const transform &b)
+{
+    return transform(a.m_linear * b.m_linear, a.apply_point(b.m_translation));
+}
+
+/* A transformed reference to geometry that lives somewhere else.  The
+ * geometry (which can be a whole bvh_node of its own) is shared between every
+ * instance of it, so each extra copy in the scene only costs a transform and
+ * a box.  Putting the instances themselves in a bvh_node gives a two level
+ * hierarchy: the top level finds the instances a ray passes near, and the
+ * bottom level is searched in the object's own space. */
+class instance : public hittable {
+public:
+    instance(const hittable *geometry, const transform &object_to_world,
+             material *override_material = nullptr) :
+        m_geometry(geometry),
+        m_world_to_object(object_to_world.inverse()),
+        m_material(override_material),
+        // Average scale from world to object space, for surface coordinate
+        // scales.  Exact unless the transform stretches unevenly.
+        m_object_units(cbrt(fabs(m_world_to_object.m_linear.determinant())))
+    {
+        // Transform all eight corners of the object's box into world space
+        // and take the box around those.  An unbounded (or empty) object
+        // makes an unbounded instance.
+        aabb box;
+        m_bounded = geometry->bounding_box(box);
+        for (int i = 0; m_bounded && i < 8; i++) {
+            vec3<float> corner(i & 1 ? box.m_max.x() : box.m_min.x(),
+                               i & 2 ? box.m_max.y() : box.m_min.y(),
+                               i & 4 ? box.m_max.z() : box.m_min.z());
+            vec3<float> p = object_to_world.apply_point(corner);
+            m_box = i == 0 ? aabb(p, p) : surrounding_box(m_box, aabb(p, p));
+        }
+    }
+
+    virtual bool hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const;
+    virtual bool bounding_box(aabb &box) const
+    {
+        box = m_box;
+        return m_bounded;
+    }
+
+private:
+    const hittable *m_geometry;
+    transform m_world_to_object;
+    material *m_material;
+    float m_object_units;
+    aabb m_box;
+    bool m_bounded;
+};
+
+bool
+instance::hit(const ray<float> &r, float t_min, float t_max,
+              hit_record &rec) const
+{
+    // The direction isn't renormalized, so 't' means the same thing in
+    // both spaces and t_min/t_max can be passed through untouched.
+    ray<float> object_ray(m_world_to_object.apply_point(r.origin()),
+                          m_world_to_object.apply_vector(r.direction()));
+    if (!m_geometry->hit(object_ray, t_min, t_max, rec)) {
+        return false;
+    }
+
+    rec.p = r.point_at_parameter(rec.t);
+    // Normals transform by the inverse transpose of the object-to-world
+    // matrix, which is just the transpose of the matrix we already have.
+    rec.normal = unit_vector(m_world_to_object.m_linear.transpose() * rec.normal);
+    rec.uv_scale *= m_object_units;
+    if (m_material) {
+        rec.mat_ptr = m_material;
+    }
+    return true;
+}
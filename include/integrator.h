@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cfloat>
+
+#include "denoise.h"
+#include "hittable.h"
+#include "light.h"
+#include "material.h"
+
+/* Weight for a sample taken with density 'pdf', when another strategy could
+ * have produced the same sample with density 'other_pdf'.  The weights of the
+ * two strategies always add up to one, and each one gets most of the weight
+ * where it's the better of the two. */
+inline float
+power_heuristic(float pdf, float other_pdf)
+{
+    float a = pdf * pdf;
+    float b = other_pdf * other_pdf;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+/* The integrator works on any scene type with these members:
+ *
+ *   material_handle, whatever hit() uses to say what material it found,
+ *   hit(r, t_min, t_max, rec, material),
+ *   scatter(material, r_in, rec, attenuation, scattered),
+ *   emitted(material, rec) and
+ *   scattering_pdf(material, r_in, rec, scattered).
+ *
+ * This one is for a world of hittables and materials with virtual functions.
+ * static_scene (static_scene.h) is one where all the types are known at
+ * compile time. */
+class virtual_scene {
+public:
+    typedef const material *material_handle;
+
+    virtual_scene(const hittable *world) : m_world(world) {}
+
+    bool hit(const ray<float> &r, float t_min, float t_max, hit_record &rec,
+             material_handle &material) const
+    {
+        if (!m_world->hit(r, t_min, t_max, rec)) {
+            return false;
+        }
+        material = rec.mat_ptr;
+        return true;
+    }
+
+    bool scatter(material_handle m, const ray<float> &r_in, hit_record &rec,
+                 vec3<float> &attenuation, ray<float> &scattered) const
+    {
+        return m->scatter(r_in, rec, attenuation, scattered);
+    }
+
+    vec3<float> emitted(material_handle m, const hit_record &rec) const
+    {
+        return m->emitted(rec);
+    }
+
+    float scattering_pdf(material_handle m, const ray<float> &r_in,
+                         const hit_record &rec, const ray<float> &scattered) const
+    {
+        return m->scattering_pdf(r_in, rec, scattered);
+    }
+
+private:
+    const hittable *m_world;
+};
+
+/* How wide a ray is: 'width' at its origin, growing by 'spread' per unit of
+ * distance (a simplified ray cone, after Akenine-Moller et al., "Texture
+ * Level of Detail Strategies for Real-Time Ray Tracing").  Textures use it to
+ * pick a mip level.  Camera rays spread by a pixel's angle. */
+struct ray_cone {
+    ray_cone(float width = 0, float spread = 0) : width(width), spread(spread) {}
+
+    float width_at(float distance) const {return width + spread * distance;}
+
+    // Diffuse bounces scatter everywhere, so what they see is blurry anyway.
+    // This is a guess, wide enough to keep indirect texture lookups off the
+    // finest levels.
+    static ray_cone after_diffuse(float width) {return ray_cone(width, 0.2f);}
+
+    float width;
+    float spread;
+};
+
+/* Light arriving at 'rec' straight from one of the lights, found by aiming a
+ * ray at a random light rather than hoping a scattered ray hits one. */
+template<typename Scene> vec3<float>
+sample_lights(const ray<float> &r_in, const hit_record &rec,
+              typename Scene::material_handle material,
+              const vec3<float> &attenuation, const Scene &scene,
+              const scene_lights &lights, int depth)
+{
+    sample_bounce(depth, 4);
+    ray<float> to_light(rec.p, lights.random(rec.p));
+    float light_pdf = lights.pdf_value(rec.p, to_light.direction());
+    float bsdf_pdf = scene.scattering_pdf(material, r_in, rec, to_light);
+    if (light_pdf <= 0 || bsdf_pdf <= 0) {
+        return vec3<float>(0, 0, 0);
+    }
+
+    // Whatever is in the way of that ray is what we see, which may or may not
+    // be the light we were aiming at.  Fog in the way scatters it with the
+    // probability that it doesn't get through.
+    sample_bounce(depth, 5);
+    hit_record light_rec;
+    typename Scene::material_handle light_material;
+    if (!scene.hit(to_light, 0.001, FLT_MAX, light_rec, light_material)) {
+        return vec3<float>(0, 0, 0);
+    }
+
+    // attenuation * bsdf_pdf is the lambertian brdf times the cosine term.
+    float weight = power_heuristic(light_pdf, bsdf_pdf);
+    return (weight * bsdf_pdf / light_pdf) * attenuation
+         * scene.emitted(light_material, light_rec);
+}
+
+/* Path tracer.  Besides following scattered rays, every diffuse hit also
+ * samples the lights directly (next event estimation).  A light can then be
+ * found either way, so both are weighted with multiple importance sampling:
+ * 'bsdf_pdf' is the density with which the previous bounce picked 'r', or 0
+ * if it wasn't a diffuse bounce (camera rays, mirrors, glass), in which case
+ * the lights weren't sampled and whatever 'r' hits counts in full.
+ *
+ * Paths stop scattering after 'max_depth' bounces.  If 'features' is given,
+ * what 'r' hits first is added to it for the denoiser.  'cone' is how wide
+ * 'r' is, for texture filtering. */
+template<typename Scene> vec3<float>
+trace(const ray<float> &r, const Scene &scene, const scene_lights &lights,
+      int max_depth = 50, int depth = 0, float bsdf_pdf = 0,
+      pixel_features *features = nullptr, const ray_cone &cone = ray_cone())
+{
+    hit_record rec;
+    typename Scene::material_handle material;
+    // For media 'r' goes through, to pick how far it gets.
+    sample_bounce(depth, 3);
+    if (scene.hit(r, 0.001, FLT_MAX, rec, material)) {
+        sample_bounce(depth);
+        rec.footprint = cone.width_at(rec.t * r.direction().length());
+        if (features) {
+            features->normal += rec.normal;
+            features->depth += rec.t * r.direction().length();
+        }
+        vec3<float> emitted = scene.emitted(material, rec);
+        // Only lights need weighting, and finding the weight means
+        // intersecting 'r' with every light, so skip it for everything else.
+        if (bsdf_pdf > 0 && !lights.empty() && emitted.squared_length() > 0) {
+            emitted *= power_heuristic(bsdf_pdf,
+                                       lights.pdf_value(r.origin(), r.direction()));
+        }
+
+        ray<float> scattered;
+        vec3<float> attenuation;
+        if (depth < max_depth && scene.scatter(material, r, rec, attenuation, scattered)){
+            float scattered_pdf = scene.scattering_pdf(material, r, rec, scattered);
+            if (features) {
+                features->albedo += attenuation;
+            }
+            vec3<float> direct(0, 0, 0);
+            if (scattered_pdf > 0 && !lights.empty()) {
+                direct = sample_lights(r, rec, material, attenuation, scene,
+                                       lights, depth);
+            }
+            ray_cone scattered_cone = scattered_pdf > 0
+                                    ? ray_cone::after_diffuse(rec.footprint)
+                                    : ray_cone(rec.footprint, cone.spread);
+            return emitted + direct
+                 + attenuation * trace(scattered, scene, lights, max_depth,
+                                       depth+1, scattered_pdf, nullptr,
+                                       scattered_cone);
+        } else {
+            if (features) {
+                features->albedo += vec3<float>(1, 1, 1);
+            }
+            return emitted;
+        }
+    }
+
+    if (features) {
+        // Nothing to see, except for the sky.
+        const float far_away = 1e4;
+        features->albedo += vec3<float>(1, 1, 1);
+        features->normal -= unit_vector(r.direction());
+        features->depth += far_away;
+    }
+    if (lights.sky()) {
+        // Background
+        vec3<float> unit_direction(unit_vector(r.direction()));
+        float t = 0.5 * (unit_direction.y() + 1.0);
+        return (1.0f-t) * vec3<float>(1.0,1.0,1.0) + t * vec3<float>(0.5, 0.7, 1.0);
+    } else {
+        return vec3<float>(0, 0, 0);
+    }
+}
+
+inline vec3<float>
+color(const ray<float> &r, const hittable *world, const scene_lights &lights,
+      int max_depth = 50, int depth = 0, float bsdf_pdf = 0,
+      pixel_features *features = nullptr, const ray_cone &cone = ray_cone())
+{
+    return trace(r, virtual_scene(world), lights, max_depth, depth, bsdf_pdf,
+                 features, cone);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "bvh.h"
+
+/* A bvh_node that doesn't split itself until a ray first gets inside its box.
+ * Building the root only costs one pass over the objects to find its box, so
+ * rendering can start right away, and parts of the scene that no ray ever
+ * reaches never get built at all.
+ *
+ * Safe to hit from several threads: the first one in builds the children
+ * and the rest wait for it (std::call_once), after which the node is read
+ * only.
+ *
+ * Like bvh_node, the root keeps objects with no bounding box out of the tree,
+ * in a list beside it. */
+class lazy_bvh_node : public hittable {
+public:
+    // Ranges smaller than this are handed to a regular bvh_node, since
+    // they're cheap to build and deferring them isn't worth the locking.
+    static const size_t eager_threshold = 8;
+
+    lazy_bvh_node(const std::list<hittable*> &objects) :
+        m_objects(std::make_shared<std::vector<hittable*> >(objects.begin(),
+                                                            objects.end())),
+        m_start(0),
+        m_end(set_aside_unbounded(*m_objects, 0, m_objects->size())),
+        m_unbounded(unbounded_list(*m_objects, m_end, m_objects->size()))
+    {
+        find_box();
+    }
+
+    // Everything in [start, end) has to have a box.
+    lazy_bvh_node(std::shared_ptr<std::vector<hittable*> > objects,
+                  size_t start, size_t end) :
+        m_objects(objects),
+        m_start(start),
+        m_end(end),
+        m_unbounded(nullptr)
+    {
+        find_box();
+    }
+
+    virtual bool hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const;
+    virtual bool bounding_box(aabb &box) const
+    {
+        box = m_box;
+        return m_start < m_end && !m_unbounded;
+    }
+
+private:
+    void find_box()
+    {
+        if (m_start == m_end) {
+            // No objects, so no box; hit() never gets past checking for that.
+            return;
+        }
+        m_box = object_box((*m_objects)[m_start]);
+        for (size_t i = m_start + 1; i < m_end; i++) {
+            m_box = surrounding_box(m_box, object_box((*m_objects)[i]));
+        }
+    }
+
+    void expand() const;
+
+    std::shared_ptr<std::vector<hittable*> > m_objects;
+    size_t m_start;
+    size_t m_end;
+    // The root's objects with no box, or null.
+    hittable *m_unbounded;
+    aabb m_box;
+
+    // Filled in by expand(), the first time a ray reaches this node.
+    mutable std::once_flag m_built;
+    mutable hittable *m_left;
+    mutable hittable *m_right;
+};
+
+void
+lazy_bvh_node::expand() const
+{
+    std::vector<hittable*> &objects = *m_objects;
+    size_t span = m_end - m_start;
+    if (span <= eager_threshold) {
+        m_left = new bvh_node(objects, m_start, m_end);
+        m_right = nullptr;
+        return;
+    }
+
+    // Only this node ever touches [m_start, m_end), and its children don't
+    // exist yet, so reordering the shared vector here is safe.
+    size_t mid = split_objects(objects, m_start, m_end);
+    m_left = new lazy_bvh_node(m_objects, m_start, mid);
+    m_right = new lazy_bvh_node(m_objects, mid, m_end);
+}
+
+bool
+lazy_bvh_node::hit(const ray<float> &r, float t_min, float t_max,
+                   hit_record &rec) const
+{
+    bool hit_unbounded = m_unbounded && m_unbounded->hit(r, t_min, t_max, rec);
+    if (hit_unbounded) {
+        t_max = rec.t;
+    }
+    if (m_start == m_end || !m_box.hit(r, t_min, t_max)) {
+        return hit_unbounded;
+    }
+
+    std::call_once(m_built, &lazy_bvh_node::expand, this);
+
+    bool hit_left = m_left->hit(r, t_min, t_max, rec);
+    if (!m_right) {
+        return hit_left || hit_unbounded;
+    }
+    bool hit_right = m_right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    return hit_left || hit_right || hit_unbounded;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "hittable.h"
+
+/* The lights in a scene: emissive objects that color() samples directly
+ * instead of waiting for a bounce to find them, plus whether the sky
+ * gradient lights the scene too. */
+class scene_lights {
+public:
+    scene_lights(bool sky = true) : m_sky(sky) {}
+
+    void add(hittable *light) {m_lights.push_back(light);}
+    bool empty() const {return m_lights.empty();}
+    bool sky() const {return m_sky;}
+
+    // Direction from 'origin' towards one of the lights, picked uniformly.
+    vec3<float> random(const vec3<float> &origin) const
+    {
+        size_t i = size_t(random_float() * m_lights.size());
+        if (i >= m_lights.size()) {
+            i = m_lights.size() - 1;
+        }
+        return m_lights[i]->random(origin);
+    }
+
+    // Density of random() picking 'direction': the average over the lights,
+    // since any of them could have been picked.
+    float pdf_value(const vec3<float> &origin, const vec3<float> &direction) const
+    {
+        if (m_lights.empty()) {
+            return 0;
+        }
+        float sum = 0;
+        for (auto it = m_lights.begin(); it != m_lights.end(); it++) {
+            sum += (*it)->pdf_value(origin, direction);
+        }
+        return sum / m_lights.size();
+    }
+
+private:
+    std::vector<hittable*> m_lights;
+    bool m_sky;
+};
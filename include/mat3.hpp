@@ -0,0 +1,77 @@
+#pragma once
+
+#include "vec3.hpp"
+
+/* Row-major 3x3 matrix, just enough linear algebra to rotate and scale
+ * vectors for instancing. */
+template <typename T = float> class mat3
+{
+public:
+    mat3() {}
+    mat3(const vec3<T> &r0, const vec3<T> &r1, const vec3<T> &r2)
+    {
+        for (int c = 0; c < 3; c++) {
+            m[0][c] = r0[c];
+            m[1][c] = r1[c];
+            m[2][c] = r2[c];
+        }
+    }
+
+    static mat3 identity()
+    {
+        return mat3(vec3<T>(1, 0, 0), vec3<T>(0, 1, 0), vec3<T>(0, 0, 1));
+    }
+
+    static mat3 diagonal(const vec3<T> &d)
+    {
+        return mat3(vec3<T>(d[0], 0, 0), vec3<T>(0, d[1], 0), vec3<T>(0, 0, d[2]));
+    }
+
+    inline vec3<T> row(int r) const {return vec3<T>(m[r][0], m[r][1], m[r][2]);}
+
+    mat3 transpose() const
+    {
+        mat3 out;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                out.m[r][c] = m[c][r];
+            }
+        }
+        return out;
+    }
+
+    T determinant() const
+    {
+        return dot(row(0), cross(row(1), row(2)));
+    }
+
+    // Inverse via the adjugate: the columns of the inverse are the cross
+    // products of pairs of rows, divided by the determinant.
+    mat3 inverse() const
+    {
+        T inv_det = T(1) / determinant();
+        vec3<T> c0 = cross(row(1), row(2)) * inv_det;
+        vec3<T> c1 = cross(row(2), row(0)) * inv_det;
+        vec3<T> c2 = cross(row(0), row(1)) * inv_det;
+        return mat3(c0, c1, c2).transpose();
+    }
+
+    T m[3][3];
+};
+
+template<typename T> inline vec3<T>
+operator*(const mat3<T> &a, const vec3<T> &v) {
+    return vec3<T>(dot(a.row(0), v), dot(a.row(1), v), dot(a.row(2), v));
+}
+
+template<typename T> inline mat3<T>
+operator*(const mat3<T> &a, const mat3<T> &b) {
+    mat3<T> bt = b.transpose();
+    mat3<T> out;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            out.m[r][c] = dot(a.row(r), bt.row(c));
+        }
+    }
+    return out;
+}
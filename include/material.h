@@ -2,26 +2,51 @@
 
 #include "vec3.hpp"
 #include "hittable.h"
+#include "texture.h"
+
+/* Random point on the surface of the unit sphere.  Adding this to a normal
+ * gives directions with a cosine distribution around it, which is exactly
+ * what a lambertian surface scatters. */
+vec3<float> random_unit_vector() {
+    float u, v;
+    random_float2(u, v);
+    float z = 2 * u - 1;
+    float a = 2 * M_PI * v;
+    float r = sqrt(1 - z*z);
+    return vec3<float>(r * cos(a), r * sin(a), z);
+}
 
 vec3<float> random_in_unit_sphere() {
-    thread_local unsigned short rand_seed[3] = {0x1234, 0xabcd, 0x330e};
-    vec3<float> p;
-    do {
-        // Produce a random point in [-1,1) for all dimensions
-        p = 2.0f * vec3<float>(erand48(rand_seed), erand48(rand_seed), erand48(rand_seed))
-            - vec3<float>(1, 1, 1);
-        // And only allow shorter ones out (ones that fit in a unit-circle)
-    } while (p.squared_length() >= 1.0);
-    // hmm: Why do I do this in a while-loop instead of converting the vector
-    // to a unit-vector?  Perhaps this would build a bias towards the edges of
-    // the circle?  I bet I could build an image to simulate this!
-    return p;
+    // A direction, and a distance along it.  The cube root is because the
+    // volume inside radius r grows with r^3, so without it points would bunch
+    // up in the middle.
+    //
+    // This used to pick points in the [-1,1) cube until one landed inside the
+    // sphere, but that uses up a different number of random numbers every
+    // time, which throws off the sampler's dimensions.
+    vec3<float> direction = random_unit_vector();
+    return cbrt(random_float()) * direction;
 }
 
 class material {
 public:
     virtual bool scatter(const ray<float> &r_in, struct hit_record &rec,
                          vec3<float> &attenuation, ray<float> &r_out) const = 0;
+
+    // Light given off by the surface itself.
+    virtual vec3<float> emitted(const hit_record &rec) const
+    {
+        return vec3<float>(0, 0, 0);
+    }
+
+    // Probability density (per solid angle) of scatter() picking 'scattered'.
+    // Zero means the material only scatters in one direction (mirrors and
+    // glass), so there's no point sampling lights for it.
+    virtual float scattering_pdf(const ray<float> &r_in, const hit_record &rec,
+                                 const ray<float> &scattered) const
+    {
+        return 0;
+    }
 };
 
 /* Like a lambertian material, but the color changes based on where the object
@@ -60,7 +85,8 @@ class debugTexture : public material {
 
 class lambertian : public material {
 public:
-    lambertian(const vec3<float> &albedo) : m_albedo(albedo) {}
+    lambertian(const vec3<float> &albedo) : m_albedo(albedo), m_texture(nullptr) {}
+    lambertian(texture *albedo) : m_albedo(0, 0, 0), m_texture(albedo) {}
 
     virtual bool scatter(const ray<float> &r_in, struct hit_record &rec,
                          vec3<float> &attenuation, ray<float> &r_out) const
@@ -70,14 +96,28 @@ public:
         // known destination point yet.
         // Also, couldn't I just get rid of rec.p?  We cancel it out anyways
         // when building the ray...
-        vec3<float> target = rec.p + rec.normal + random_in_unit_sphere();
+        // This uses a point on the unit sphere, not in it, so the directions
+        // follow cos(theta)/pi exactly and scattering_pdf() can say so.
+        vec3<float> target = rec.p + rec.normal + random_unit_vector();
         r_out = ray<float>(rec.p, target - rec.p);
-        attenuation = m_albedo;
+        attenuation = m_texture ? m_texture->value(rec) : m_albedo;
         return true;
     }
 
+    virtual float scattering_pdf(const ray<float> &r_in, const hit_record &rec,
+                                 const ray<float> &scattered) const
+    {
+        float cosine = dot(rec.normal, unit_vector(scattered.direction()));
+        return cosine < 0 ? 0 : cosine / M_PI;
+    }
+
 private:
+    // Most materials are one flat color, which is kept here rather than in a
+    // solid_color so hitting them doesn't need a virtual call (static_scene
+    // is there to get rid of those).  Only textured ones set m_texture.
     vec3<float> m_albedo;
+    // Shared, not owned: copies (like static_scene's) use the same one.
+    texture *m_texture;
 };
 
 class metal : public material {
@@ -109,7 +149,6 @@ public:
 
     virtual bool scatter(const ray<float> &r_in, struct hit_record &rec,
                          vec3<float> &attenuation, ray<float> &scattered) const {
-        thread_local unsigned short rand_seed[3] = {0x1234, 0xabcd, 0x330e};
         vec3<float> outward_normal;
         vec3<float> reflected = reflect(r_in.direction(), rec.normal);
         // Undocumented by the author, but ni_over_nt seems to be the ratio of
@@ -140,7 +179,7 @@ public:
             reflect_probability =  1.0;
         }
 
-        if (erand48(rand_seed) < reflect_probability) {
+        if (random_float() < reflect_probability) {
             scattered = ray<float>(rec.p, reflected);
         } else {
             scattered = ray<float>(rec.p, refracted);
@@ -151,3 +190,52 @@ public:
 
     float ref_idx; // refractive index
 };
+
+/* Gives off light of its own and doesn't reflect anything. */
+class diffuse_light : public material {
+public:
+    diffuse_light(const vec3<float> &emit) : m_emit(emit) {}
+
+    virtual bool scatter(const ray<float> &r_in, struct hit_record &rec,
+                         vec3<float> &attenuation, ray<float> &r_out) const
+    {
+        return false;
+    }
+
+    virtual vec3<float> emitted(const hit_record &rec) const
+    {
+        return m_emit;
+    }
+
+private:
+    vec3<float> m_emit;
+};
+
+/* The phase function of a constant_medium: scatters the same amount in every
+ * direction, whichever way the light came from. */
+class isotropic : public material {
+public:
+    isotropic(const vec3<float> &albedo) : m_albedo(albedo), m_texture(nullptr) {}
+    isotropic(texture *albedo) : m_albedo(0, 0, 0), m_texture(albedo) {}
+
+    virtual bool scatter(const ray<float> &r_in, struct hit_record &rec,
+                         vec3<float> &attenuation, ray<float> &r_out) const
+    {
+        r_out = ray<float>(rec.p, random_unit_vector());
+        attenuation = m_texture ? m_texture->value(rec) : m_albedo;
+        return true;
+    }
+
+    // Uniform over the sphere of directions.  Not zero, so fog gets lit by
+    // sampling the lights, like a diffuse surface.
+    virtual float scattering_pdf(const ray<float> &r_in, const hit_record &rec,
+                                 const ray<float> &scattered) const
+    {
+        return 1 / (4 * M_PI);
+    }
+
+private:
+    // Like lambertian's: a flat color, unless m_texture is set.
+    vec3<float> m_albedo;
+    texture *m_texture;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "vec3.hpp"
+
+/* Perlin's gradient noise: a random unit vector at every integer lattice
+ * point, and in between, the dot products with those vectors blended
+ * smoothly.  Smooth, but random at any scale bigger than one lattice cell.
+ *
+ * The lattice is drawn from its own seed, not from the sampler, so the noise
+ * is the same for every ray. */
+class perlin {
+public:
+    perlin(unsigned short seed = 0x9e37)
+    {
+        unsigned short rand_seed[3] = {0x1234, 0xabcd, seed};
+        for (int i = 0; i < point_count; i++) {
+            // Uniform on the sphere.
+            float z = 2 * erand48(rand_seed) - 1;
+            float a = 2 * M_PI * erand48(rand_seed);
+            float r = sqrt(1 - z*z);
+            m_gradients[i] = vec3<float>(r * cos(a), r * sin(a), z);
+        }
+        generate_permutation(m_perm_x, rand_seed);
+        generate_permutation(m_perm_y, rand_seed);
+        generate_permutation(m_perm_z, rand_seed);
+    }
+
+    // In about [-1, 1].
+    float noise(const vec3<float> &p) const
+    {
+        int i = int(floor(p.x()));
+        int j = int(floor(p.y()));
+        int k = int(floor(p.z()));
+        float u = p.x() - i;
+        float v = p.y() - j;
+        float w = p.z() - k;
+
+        // Hermite smoothing, so the blend has no creases at cell borders.
+        float uu = u*u*(3 - 2*u);
+        float vv = v*v*(3 - 2*v);
+        float ww = w*w*(3 - 2*w);
+
+        float sum = 0;
+        for (int di = 0; di < 2; di++) {
+            for (int dj = 0; dj < 2; dj++) {
+                for (int dk = 0; dk < 2; dk++) {
+                    const vec3<float> &gradient = m_gradients[
+                        m_perm_x[(i + di) & mask] ^ m_perm_y[(j + dj) & mask]
+                        ^ m_perm_z[(k + dk) & mask]];
+                    vec3<float> offset(u - di, v - dj, w - dk);
+                    sum += (di ? uu : 1 - uu) * (dj ? vv : 1 - vv) * (dk ? ww : 1 - ww)
+                         * dot(gradient, offset);
+                }
+            }
+        }
+        return sum;
+    }
+
+    // Several octaves of noise added up, each at twice the frequency and half
+    // the weight of the last.
+    float turbulence(vec3<float> p, int octaves = 7) const
+    {
+        float sum = 0;
+        float weight = 1;
+        for (int i = 0; i < octaves; i++) {
+            sum += weight * noise(p);
+            weight *= 0.5f;
+            p *= 2.0f;
+        }
+        return fabs(sum);
+    }
+
+private:
+    static const int point_count = 256;
+    static const int mask = point_count - 1;
+
+    static void generate_permutation(int *perm, unsigned short rand_seed[3])
+    {
+        for (int i = 0; i < point_count; i++) {
+            perm[i] = i;
+        }
+        for (int i = point_count - 1; i > 0; i--) {
+            int target = int(erand48(rand_seed) * (i + 1));
+            int swap = perm[i];
+            perm[i] = perm[target];
+            perm[target] = swap;
+        }
+    }
+
+    vec3<float> m_gradients[point_count];
+    int m_perm_x[point_count];
+    int m_perm_y[point_count];
+    int m_perm_z[point_count];
+};
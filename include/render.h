@@ -0,0 +1,31 @@
+#pragma once
+
+#include "camera.h"
+#include "integrator.h"
+#include "sampler.h"
+
+/* Traces samples [first_sample, first_sample + count) of pixel (i, j) in an
+ * nx by ny image, drawing from 'pixel_sampler', and returns their sum in
+ * linear color.  Starting past zero lets progressive renders add more samples
+ * to a pixel later without repeating the ones it already has.
+ *
+ * Paths stop after 'max_depth' bounces.  If 'features' is given, the first
+ * hit of every sample is added to it. */
+inline vec3<float>
+trace_pixel(const camera &cam, const hittable &world, const scene_lights &lights,
+            sampler &pixel_sampler, int i, int j, int nx, int ny,
+            int first_sample, int count, int max_depth = 50,
+            pixel_features *features = nullptr)
+{
+    current_sampler() = &pixel_sampler;
+    ray_cone pixel_cone(0, cam.pixel_spread(ny));
+    vec3<float> sum(0, 0, 0);
+    for (int s = first_sample; s < first_sample + count; s++) {
+        pixel_sampler.start_sample(i, j, s);
+        float du, dv;
+        random_float2(du, dv);
+        ray<float> r = cam.get_ray((i + du) / float(nx), (j + dv) / float(ny));
+        sum += color(r, &world, lights, max_depth, 0, 0, features, pixel_cone);
+    }
+    return sum;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of threads that stay around between frames.  start() hands
+ * every worker the same job, job(worker) with 'worker' from 0 to size() - 1,
+ * and returns right away; wait() waits for them all to finish it.
+ *
+ * Starting threads with std::async for every frame allocates their state on
+ * the heap every time.  These threads are made once, and running a job only
+ * takes a lock and a wakeup, so a program rendering frame after frame doesn't
+ * have to allocate anything to do it.
+ *
+ * One job at a time, and the job has to stay alive until wait() returns. */
+class render_workers {
+public:
+    render_workers(unsigned threads) :
+        m_job(nullptr),
+        m_run(nullptr),
+        m_generation(0),
+        m_running(0),
+        m_stopping(false)
+    {
+        for (unsigned t = 0; t < std::max(1u, threads); t++) {
+            m_threads.push_back(std::thread(&render_workers::work, this, t));
+        }
+    }
+
+    ~render_workers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_start.notify_all();
+        }
+        for (auto it = m_threads.begin(); it != m_threads.end(); it++) {
+            it->join();
+        }
+    }
+
+    unsigned size() const {return m_threads.size();}
+
+    template<typename Job> void start(Job &job)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_run = &run_job<Job>;
+        m_running = m_threads.size();
+        m_generation++;
+        m_start.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() {return m_running == 0;});
+    }
+
+private:
+    // The job's type is gone by the time a worker picks it up, so start()
+    // leaves a pointer to this, which knows it.
+    template<typename Job> static void run_job(void *job, unsigned worker)
+    {
+        (*static_cast<Job *>(job))(worker);
+    }
+
+    void work(unsigned worker)
+    {
+        unsigned done = 0;
+        for (;;) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]() {return m_stopping || m_generation != done;});
+            if (m_stopping) {
+                return;
+            }
+            done = m_generation;
+            void *job = m_job;
+            void (*run)(void *, unsigned) = m_run;
+            lock.unlock();
+
+            run(job, worker);
+
+            lock.lock();
+            if (--m_running == 0) {
+                m_done.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    void *m_job;
+    void (*m_run)(void *, unsigned);
+    // Bumped by every start(), so workers can tell a new job from the one
+    // they just finished.
+    unsigned m_generation;
+    unsigned m_running;
+    bool m_stopping;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/* A fixed number of slots for work items that are produced out of order but
+ * have to be consumed in order, like bands of an image finishing on different
+ * threads that get written to a file top to bottom.
+ *
+ * Item n lives in slot n % window.  A producer can't start on an item until
+ * the consumer is less than 'window' items behind it, so memory stays bounded
+ * by the window no matter how many items there are.  Slots are reused rather
+ * than freed, so whatever buffers they hold keep their capacity from one item
+ * to the next.
+ *
+ * Producers must take items in increasing order (e.g. from a shared counter),
+ * otherwise one could wait on a slot that will never be freed. */
+template<typename T>
+class reorder_buffer {
+public:
+    reorder_buffer(size_t window) :
+        m_slots(window),
+        m_ready(window, false),
+        m_next(0)
+        {}
+
+    // Waits until item 'index' fits in the window and returns its slot to be
+    // filled in.
+    T &acquire(size_t index)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]() { return index < m_next + m_slots.size(); });
+        return m_slots[index % m_slots.size()];
+    }
+
+    // Item 'index' is filled in.
+    void release(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready[index % m_slots.size()] = true;
+        m_changed.notify_all();
+    }
+
+    // Waits for the next item in order to be filled in and returns it.
+    T &front()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]() { return m_ready[m_next % m_slots.size()]; });
+        return m_slots[m_next % m_slots.size()];
+    }
+
+    // Done with front(), its slot can take the item 'window' places later.
+    void pop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready[m_next % m_slots.size()] = false;
+        m_next++;
+        m_changed.notify_all();
+    }
+
+    // Numbers items from 0 again, for the next batch.  Everything has to
+    // have been popped.
+    void restart()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_next = 0;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<T> m_slots;
+    std::vector<bool> m_ready;
+    // The next item front() will return.
+    size_t m_next;
+};
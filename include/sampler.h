@@ -0,0 +1,373 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Sample generators.
+ *
+ * Every random decision made while tracing one sample of a pixel gets its own
+ * "dimension": 0 and 1 jitter the position in the pixel, 2 and 3 pick a point
+ * on the lens, and each bounce gets a block of dimensions_per_bounce more for
+ * its scattering and light sampling decisions.  A sampler hands out a number
+ * in [0,1) for a given pixel, sample index and dimension.  The better ones
+ * spread the samples of a pixel evenly over each dimension (and over pairs of
+ * them), instead of letting them clump like independent random numbers do,
+ * which makes the pixel converge faster.
+ *
+ * Every sampler's numbers depend only on the pixel, sample index and
+ * dimension, never on what was drawn before, so images don't change with the
+ * number of threads or the order pixels get rendered in.
+ *
+ * Code that needs a random number calls random_float() (or random_float2()
+ * for a pair that should be stratified together), which draws the next
+ * dimension from the current thread's sampler, or falls back on erand48 if
+ * there isn't one. */
+class sampler {
+public:
+    static const int first_bounce_dimension = 4;
+    static const int dimensions_per_bounce = 8;
+
+    sampler(int samples_per_pixel) :
+        m_samples_per_pixel(samples_per_pixel),
+        m_pixel_seed(0),
+        m_index(0),
+        m_dimension(0)
+        {}
+    virtual ~sampler() {}
+
+    void start_sample(int x, int y, int index);
+
+    void start_bounce(int depth, int offset)
+    {
+        m_dimension = first_bounce_dimension + depth * dimensions_per_bounce + offset;
+    }
+
+    float get_1d()
+    {
+        return sample_1d(m_dimension++);
+    }
+
+    // Pairs always start on an even dimension, so the same two dimensions
+    // always get stratified together.
+    void get_2d(float &u, float &v)
+    {
+        m_dimension += m_dimension & 1;
+        sample_2d(m_dimension, u, v);
+        m_dimension += 2;
+    }
+
+protected:
+    virtual float sample_1d(int dimension) = 0;
+    virtual void sample_2d(int dimension, float &u, float &v)
+    {
+        u = sample_1d(dimension);
+        v = sample_1d(dimension + 1);
+    }
+
+    int m_samples_per_pixel;
+    // Different for every pixel, so neighbouring pixels don't get the same
+    // pattern.
+    uint32_t m_pixel_seed;
+    uint32_t m_index;
+    int m_dimension;
+};
+
+/// Hashing, for seeding and scrambling
+
+// "lowbias32" integer hash by Chris Wellons.
+inline uint32_t
+hash_uint(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t
+hash_combine(uint32_t seed, uint32_t value)
+{
+    return hash_uint(seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2)));
+}
+
+// Top 24 bits to a float in [0,1), which is all the precision a float has.
+inline float
+uint_to_unit_float(uint32_t x)
+{
+    return (x >> 8) * (1.0f / (1u << 24));
+}
+
+inline uint32_t
+reverse_bits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+/**
+ * Random permutation of [0, length), picked by 'seed' (Kensler, "Correlated
+ * Multi-Jittered Sampling").  Hashes within the next power of two up and
+ * tries again until it lands inside the range.
+ */
+inline uint32_t
+permute(uint32_t i, uint32_t length, uint32_t seed)
+{
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+void
+sampler::start_sample(int x, int y, int index)
+{
+    m_pixel_seed = hash_combine(hash_uint(x), y);
+    m_index = index;
+    m_dimension = 0;
+}
+
+/// Generators
+
+/* Independent random numbers, like plain Monte Carlo.  Each one is a hash of
+ * the pixel, sample index and dimension rather than the next number from a
+ * running generator, so a pixel comes out the same no matter which thread
+ * renders it or what that thread rendered before.  'seed' picks a different
+ * set of numbers. */
+class random_sampler : public sampler {
+public:
+    random_sampler(int samples_per_pixel, uint32_t seed = 0x330e) :
+        sampler(samples_per_pixel),
+        m_seed(hash_uint(seed))
+        {}
+
+protected:
+    virtual float sample_1d(int dimension)
+    {
+        uint32_t sample_seed = hash_combine(m_pixel_seed ^ m_seed, m_index);
+        return uint_to_unit_float(hash_combine(sample_seed, dimension));
+    }
+
+    uint32_t m_seed;
+};
+
+/* Jittered stratification: each dimension (or pair) is cut into as many
+ * strata as there are samples per pixel and every sample lands in a
+ * different one, at a random spot inside it.  Which sample gets which
+ * stratum is shuffled separately for every dimension, so the dimensions
+ * aren't correlated with each other. */
+class stratified_sampler : public sampler {
+public:
+    stratified_sampler(int samples_per_pixel) :
+        sampler(samples_per_pixel)
+    {
+        m_strata_x = ceil(sqrt(float(samples_per_pixel)));
+        m_strata_y = (samples_per_pixel + m_strata_x - 1) / m_strata_x;
+    }
+
+protected:
+    virtual float sample_1d(int dimension)
+    {
+        uint32_t seed = hash_combine(m_pixel_seed, dimension);
+        uint32_t strata = m_samples_per_pixel;
+        uint32_t stratum = permute(m_index % strata, strata, seed);
+        float jitter = uint_to_unit_float(hash_combine(seed, m_index));
+        return (stratum + jitter) / strata;
+    }
+
+    virtual void sample_2d(int dimension, float &u, float &v)
+    {
+        uint32_t seed = hash_combine(m_pixel_seed, dimension);
+        uint32_t strata = m_strata_x * m_strata_y;
+        uint32_t stratum = permute(m_index % strata, strata, seed);
+        uint32_t jitter = hash_combine(seed, m_index);
+        u = (stratum % m_strata_x + uint_to_unit_float(jitter)) / m_strata_x;
+        v = (stratum / m_strata_x + uint_to_unit_float(hash_uint(jitter))) / m_strata_y;
+    }
+
+    uint32_t m_strata_x;
+    uint32_t m_strata_y;
+};
+
+/* Halton sequence: dimension d is the radical inverse of the sample index in
+ * the d'th prime base.  Each pixel gets its own random offset (Cranley-
+ * Patterson rotation), otherwise every pixel would see the same points. */
+class halton_sampler : public sampler {
+public:
+    halton_sampler(int samples_per_pixel) : sampler(samples_per_pixel) {}
+
+protected:
+    virtual float sample_1d(int dimension)
+    {
+        static const uint32_t primes[] = {
+            2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+            59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+        };
+        uint32_t seed = hash_combine(m_pixel_seed, dimension);
+        float offset = uint_to_unit_float(seed);
+        if (dimension >= int(sizeof(primes)/sizeof(*primes))) {
+            // The higher bases are badly correlated with each other anyway.
+            return uint_to_unit_float(hash_combine(seed, m_index));
+        }
+
+        uint32_t base = primes[dimension];
+        float inv_base = 1.0f / base;
+        float inverse = 0;
+        float digit_weight = inv_base;
+        for (uint32_t i = m_index; i > 0; i /= base) {
+            inverse += (i % base) * digit_weight;
+            digit_weight *= inv_base;
+        }
+        float value = inverse + offset;
+        value -= floor(value);
+        // Rounding can land exactly on 1.
+        return value < 1 ? value : 0.99999994f;
+    }
+};
+
+/* Owen-scrambled Sobol, following Burley, "Practical Hash-based Owen
+ * Scrambling" (2020).  Every pair of dimensions uses the first two Sobol
+ * dimensions, which are well stratified together (a (0,2)-sequence).  The
+ * sample index is shuffled differently for every pair so the pairs aren't
+ * correlated, and the bits of each value are scrambled with a nested uniform
+ * (Owen) scramble seeded per pixel, which keeps the stratification but
+ * randomizes the points. */
+class sobol_sampler : public sampler {
+public:
+    sobol_sampler(int samples_per_pixel) : sampler(samples_per_pixel) {}
+
+protected:
+    virtual float sample_1d(int dimension)
+    {
+        uint32_t seed = hash_combine(m_pixel_seed, dimension);
+        uint32_t index = nested_uniform_scramble(m_index, seed);
+        return uint_to_unit_float(
+            nested_uniform_scramble(sobol_0(index), hash_uint(seed)));
+    }
+
+    virtual void sample_2d(int dimension, float &u, float &v)
+    {
+        uint32_t seed = hash_combine(m_pixel_seed, dimension);
+        uint32_t index = nested_uniform_scramble(m_index, seed);
+        u = uint_to_unit_float(nested_uniform_scramble(sobol_0(index), hash_uint(seed)));
+        v = uint_to_unit_float(nested_uniform_scramble(sobol_1(index),
+                                                       hash_uint(seed + 1)));
+    }
+
+    // First Sobol dimension, which is the base 2 van der Corput sequence.
+    static uint32_t sobol_0(uint32_t index)
+    {
+        return reverse_bits(index);
+    }
+
+    // Second Sobol dimension.
+    static uint32_t sobol_1(uint32_t index)
+    {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+            if (index & 1) {
+                result ^= v;
+            }
+        }
+        return result;
+    }
+
+    // Laine and Karras' hash, where each bit only depends on the bits below
+    // it: an Owen scramble of the reversed bits.
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+/// Drawing samples
+
+inline sampler *&
+current_sampler()
+{
+    thread_local sampler *s = nullptr;
+    return s;
+}
+
+/**
+ * Uniform random number in [0,1), the next dimension of the current sample.
+ */
+inline float
+random_float()
+{
+    sampler *s = current_sampler();
+    if (s) {
+        return s->get_1d();
+    }
+    thread_local unsigned short rand_seed[3] = {0x1234, 0xabcd, 0x330e};
+    return erand48(rand_seed);
+}
+
+/**
+ * Two uniform random numbers in [0,1), stratified together.
+ */
+inline void
+random_float2(float &u, float &v)
+{
+    sampler *s = current_sampler();
+    if (s) {
+        s->get_2d(u, v);
+    } else {
+        u = random_float();
+        v = random_float();
+    }
+}
+
+/**
+ * Move on to the dimensions for bounce number 'depth'.  'offset' picks which
+ * part of the bounce's block: scattering starts at 0, light sampling at 4,
+ * and media pick how far the incoming ray gets into them at 3 (5 for the ray
+ * towards the light).
+ */
+inline void
+sample_bounce(int depth, int offset = 0)
+{
+    sampler *s = current_sampler();
+    if (s) {
+        s->start_bounce(depth, offset);
+    }
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bvh.h"
+#include "bvh_build.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "light.h"
+#include "material.h"
+#include "sphere.h"
+#include "texture.h"
+#include "texture_cache.h"
+
+/* Scenes shared by the programs that render them.  They draw their random
+ * layouts from their own seed, so a scene comes out the same no matter what
+ * was rendered before it. */
+
+thread_local unsigned short scene_seed[3] = {0x1234, 0xabcd, 0x330e};
+
+// Starts the layouts over, so the next scene built is laid out the same as
+// if it were the first.
+inline void
+reset_scene_seed()
+{
+    scene_seed[0] = 0x1234;
+    scene_seed[1] = 0xabcd;
+    scene_seed[2] = 0x330e;
+}
+
+hittable_list
+random_scene()
+{
+    std::list<hittable*> object_list;
+
+    auto ground_material = new lambertian(vec3<>(0.5, 0.5, 0.5));
+    object_list.push_back(new sphere(vec3<>(0,-1000,0), 1000, ground_material));
+
+    for(int a = -11; a < 11; a++) {
+        for(int b = -11; b < 11; b++) {
+            // XXX what's my verion of random_double?  erand48()
+            // Is the author making any assumptions about the range of
+            // random_double?
+            auto choose_mat = erand48(scene_seed);
+            vec3<> center(a + 0.9*erand48(scene_seed), 0.2, b + 0.9*erand48(scene_seed));
+
+            if ((center - vec3<>(4, 0.2, 0)).length() > 0.9) {
+                material *sphere_material = nullptr;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = vec3<>(erand48(scene_seed),
+                                         erand48(scene_seed),
+                                         erand48(scene_seed))
+                                * vec3<>(erand48(scene_seed),
+                                         erand48(scene_seed),
+                                         erand48(scene_seed));
+                    sphere_material = new lambertian(albedo);
+                } else if (choose_mat < 0.95) {
+                    // metal
+#if 0
+                    // TODO: one day implement these random functions that the
+                    // newer edition of the book uses.  They're a lot more
+                    // readable.
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+#else
+                    auto albedo = vec3<>(0.5*(1+erand48(scene_seed)),
+                                         0.5*(1+erand48(scene_seed)),
+                                         0.5*(1+erand48(scene_seed)));
+                    auto fuzz = 0.5*erand48(scene_seed);
+#endif
+                    sphere_material = new metal(albedo, fuzz);
+                } else {
+                    // glass
+                    sphere_material = new dielectric(1.5);
+                }
+
+                if (sphere_material) {
+                    object_list.push_back(new sphere(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    // hardcoded objects
+    auto material1 = new dielectric(1.5);
+    object_list.push_back(new sphere(vec3<>(0,1,0), 1.0, material1));
+
+    auto material2 = new lambertian(vec3<>(0.4, 0.2, 0.1));
+    object_list.push_back(new sphere(vec3<>(-4, 1, 0), 1.0, material2));
+
+    auto material3 = new metal(vec3<>(0.7, 0.6, 0.5), 0);
+    object_list.push_back(new sphere(vec3<>(4, 1, 0), 1.0, material3));
+
+    hittable_list world(object_list);;
+    return world;
+    // leaking ground_material
+}
+
+/* This is basically the first scene, but modified as new materials were
+ * developed, at least through chapter 8. */
+hittable *
+spheres_scene()
+{
+    hittable *objects[] = {
+        new sphere(vec3<>(-1, 0, -1), 0.5, new metal(vec3<>(0.8, 0.8, 0.8), 0.1)),
+        new sphere(vec3<>(0, 0, -1), 0.5, new lambertian(vec3<>(0.8, 0.3, 0.3))),
+#if 0
+        new sphere(vec3<>(1, 0, -1), 0.5, new metal(vec3<>(0.8, 0.6, 0.2), 0.8)),
+#else
+        new sphere(vec3<>(1, 0, -1), 0.5, new dielectric(1.5)),
+#endif
+        new sphere(vec3<>(0, -100.5, -1), 100, new lambertian(vec3<>(0.5, 0.5, 0.5))),
+    };
+    return new hittable_list(objects, sizeof(objects)/sizeof(*objects));
+}
+
+/* This is a scene that shows off refraction. */
+hittable *
+refraction_scene()
+{
+    hittable *objects[] = {
+        new sphere(vec3<>(0,0,-1), 0.5, new lambertian(vec3<>(0.1, 0.2, 0.5))),
+        new sphere(vec3<>(1,0,-1), 0.5, new metal(vec3<>(0.8, 0.6, 0.2), 0.0)),
+        new sphere(vec3<>(-1,0,-1), 0.5, new dielectric(1.5)),
+        // inside of bubble
+        new sphere(vec3<>(-1,0,-1), -0.45, new dielectric(1.5)),
+        new sphere(vec3<>(0,-100.5,-1), 100, new lambertian(vec3<>(1.8, 0.8, 0.0))),
+    };
+    return new hittable_list(objects, sizeof(objects)/sizeof(*objects));
+}
+
+/* Like random_scene(), but every small object is an instance of one shared
+ * prop.  The prop is a few spheres with their own bvh_node, and the instances
+ * go in a second bvh_node on top of it, so adding more copies only costs a
+ * transform each. */
+hittable *
+instanced_scene(int grid = 11)
+{
+    // The shared prop: a little snowman, sitting on y=0 in its own space.
+    std::list<hittable*> prop_parts;
+    auto snow = new lambertian(vec3<>(0.9, 0.9, 0.9));
+    auto coal = new metal(vec3<>(0.2, 0.2, 0.2), 0.3);
+    prop_parts.push_back(new sphere(vec3<>(0, 0.5, 0), 0.5, snow));
+    prop_parts.push_back(new sphere(vec3<>(0, 1.2, 0), 0.35, snow));
+    prop_parts.push_back(new sphere(vec3<>(0, 1.7, 0), 0.25, snow));
+    prop_parts.push_back(new sphere(vec3<>(0, 1.75, 0.22), 0.05, coal));
+    hittable *prop = new bvh_node(prop_parts);
+
+    // A handful of shared materials instead of one per object.
+    material *palette[] = {
+        nullptr, // keep the prop's own materials
+        new lambertian(vec3<>(0.8, 0.3, 0.3)),
+        new lambertian(vec3<>(0.3, 0.5, 0.8)),
+        new metal(vec3<>(0.8, 0.7, 0.5), 0.1),
+        new dielectric(1.5),
+    };
+    const int palette_size = sizeof(palette)/sizeof(*palette);
+
+    std::vector<hittable*> instances;
+    for(int a = -grid; a < grid; a++) {
+        for(int b = -grid; b < grid; b++) {
+            vec3<> position(a + 0.9*erand48(scene_seed), 0, b + 0.9*erand48(scene_seed));
+            if ((position - vec3<>(4, 0, 0)).length() <= 0.9) {
+                continue;
+            }
+            transform xf = transform::translate(position)
+                         * transform::rotate(vec3<>(0, 1, 0), 360*erand48(scene_seed))
+                         * transform::scale(0.15 + 0.15*erand48(scene_seed));
+            material *override_material =
+                palette[int(erand48(scene_seed) * palette_size) % palette_size];
+            instances.push_back(new instance(prop, xf, override_material));
+        }
+    }
+
+    // hardcoded objects, same as random_scene()
+    instances.push_back(new sphere(vec3<>(0,1,0), 1.0, new dielectric(1.5)));
+    instances.push_back(new sphere(vec3<>(-4, 1, 0), 1.0,
+                                   new lambertian(vec3<>(0.4, 0.2, 0.1))));
+    instances.push_back(new sphere(vec3<>(4, 1, 0), 1.0,
+                                   new metal(vec3<>(0.7, 0.6, 0.5), 0)));
+    instances.push_back(new sphere(vec3<>(0,-1000,0), 1000,
+                                   new lambertian(vec3<>(0.5, 0.5, 0.5))));
+
+    std::cerr << "instanced_scene: " << instances.size() << " objects sharing "
+              << prop_parts.size() << " prop spheres" << std::endl;
+    return new bvh_node(instances);
+}
+
+/* random_scene() at night, lit by emissive spheres that get added to
+ * 'lights'.  With 'nee' false they're left out of 'lights', so they're only
+ * found by scattered rays happening to hit them, for comparison. */
+hittable *
+lights_scene(scene_lights &lights, bool nee = true)
+{
+    std::list<hittable*> object_list = random_scene().objects();
+    std::list<hittable*> light_list;
+
+    // A big soft light overhead, and small bright ones scattered among the
+    // spheres, which are the ones that are hard to find by chance.
+    light_list.push_back(new sphere(vec3<>(2, 8, 4), 2.0,
+                                    new diffuse_light(vec3<>(4, 3.6, 3))));
+    for (int i = 0; i < 6; i++) {
+        vec3<> center(-8 + 14*erand48(scene_seed), 0.15, -4 + 8*erand48(scene_seed));
+        vec3<> emit(10 + 20*erand48(scene_seed), 10 + 20*erand48(scene_seed),
+                    10 + 20*erand48(scene_seed));
+        light_list.push_back(new sphere(center, 0.15, new diffuse_light(emit)));
+    }
+
+    for (auto it = light_list.begin(); it != light_list.end(); it++) {
+        object_list.push_back(*it);
+        if (nee) {
+            lights.add(*it);
+        }
+    }
+    return build_bvh(std::vector<hittable*>(object_list.begin(), object_list.end()),
+                     std::thread::hardware_concurrency());
+}
+
+/* random_scene()'s layout with textured spheres: a checkered ground, marble
+ * and checker spheres up front, and the small spheres wearing the images in
+ * 'image_paths' in turn (or noise, without any).  The images are opened in
+ * 'cache', which decides how much of them is in memory at a time. */
+hittable *
+textures_scene(texture_cache &cache, const std::vector<std::string> &image_paths)
+{
+    std::vector<texture *> images;
+    for (size_t i = 0; i < image_paths.size(); i++) {
+        images.push_back(new image_texture(cache, cache.open(image_paths[i])));
+    }
+
+    std::vector<hittable*> objects;
+    auto ground = new checker_texture(new solid_color(vec3<>(0.2, 0.3, 0.1)),
+                                      new solid_color(vec3<>(0.9, 0.9, 0.9)));
+    objects.push_back(new sphere(vec3<>(0,-1000,0), 1000, new lambertian(ground)));
+
+    for(int a = -11; a < 11; a++) {
+        for(int b = -11; b < 11; b++) {
+            vec3<> center(a + 0.9*erand48(scene_seed), 0.2, b + 0.9*erand48(scene_seed));
+            if ((center - vec3<>(4, 0.2, 0)).length() <= 0.9) {
+                continue;
+            }
+            texture *albedo;
+            if (!images.empty()) {
+                albedo = images[((a + 11) * 22 + b + 11) % images.size()];
+            } else {
+                vec3<> color(erand48(scene_seed), erand48(scene_seed), erand48(scene_seed));
+                albedo = new noise_texture(4 + 8*erand48(scene_seed), color);
+            }
+            objects.push_back(new sphere(center, 0.2, new lambertian(albedo)));
+        }
+    }
+
+    objects.push_back(new sphere(vec3<>(0, 1, 0), 1.0,
+                                 new lambertian(new noise_texture(4))));
+    texture *left = images.empty()
+                  ? static_cast<texture *>(new noise_texture(2, vec3<>(0.4, 0.2, 0.1)))
+                  : images[0];
+    objects.push_back(new sphere(vec3<>(-4, 1, 0), 1.0, new lambertian(left)));
+    auto checks = new checker_texture(new solid_color(vec3<>(0.8, 0.1, 0.1)),
+                                      new solid_color(vec3<>(0.9, 0.8, 0.2)), 0.25);
+    objects.push_back(new sphere(vec3<>(4, 1, 0), 1.0, new lambertian(checks)));
+
+    return build_bvh(objects, std::thread::hardware_concurrency());
+}
+
+/* random_scene() with a ball of fog around the big glass sphere.  'fog' picks
+ * how it's made, to compare what they cost: "medium" is a constant_medium,
+ * "bubbles" fakes it the old way, with a cloud of tiny glass bubbles (a
+ * sphere with a negative radius one inside, like refraction_scene()'s) about
+ * as dense as the medium, and "none" leaves it out. */
+hittable *
+fog_scene(const std::string &fog = "medium")
+{
+    std::list<hittable*> object_list = random_scene().objects();
+    std::vector<hittable*> objects(object_list.begin(), object_list.end());
+
+    const vec3<> center(0, 1, 0);
+    const float radius = 1.4;
+    const float density = 1.5;
+    if (fog == "medium") {
+        objects.push_back(new constant_medium(new sphere(center, radius, nullptr),
+                                              density,
+                                              new isotropic(vec3<>(0.9, 0.9, 0.9))));
+    } else if (fog == "bubbles") {
+        // Enough bubbles that their cross sections add up to the medium's
+        // density, spread evenly through the ball but kept out of the
+        // glass sphere.
+        const float bubble_radius = 0.03;
+        auto glass = new dielectric(1.5);
+        float volume = 4 * M_PI / 3 * (radius*radius*radius - 1);
+        int count = int(density * volume / (M_PI * bubble_radius * bubble_radius));
+        for (int i = 0; i < count; i++) {
+            vec3<> offset;
+            do {
+                offset = vec3<>(2*erand48(scene_seed) - 1, 2*erand48(scene_seed) - 1,
+                                2*erand48(scene_seed) - 1) * radius;
+            } while (offset.length() > radius - bubble_radius
+                     || offset.length() < 1 + bubble_radius);
+            objects.push_back(new sphere(center + offset, bubble_radius, glass));
+            objects.push_back(new sphere(center + offset, -0.9f * bubble_radius, glass));
+        }
+    }
+
+    std::cerr << "fog_scene: " << objects.size() << " objects" << std::endl;
+    return build_bvh(objects, std::thread::hardware_concurrency());
+}
@@ -1,7 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <cfloat>
+
 #include "hittable.h"
 
+// Latitude and longitude: u goes around the y axis starting from -x, v from
+// the bottom pole (-y) to the top.  'p' is a point on the unit sphere.
+inline void
+sphere_uv(const vec3<float> &p, float &u, float &v)
+{
+    float theta = acos(std::max(-1.0f, std::min(1.0f, -p.y())));
+    float phi = atan2(-p.z(), p.x()) + M_PI;
+    u = phi / (2 * M_PI);
+    v = theta / M_PI;
+}
+
 class sphere: public hittable {
 public:
     sphere() {};
@@ -12,6 +26,19 @@ public:
         {};
     virtual bool hit(const ray<float> &r, float tmin, float tmax,
                      hit_record &rec) const;
+    virtual bool bounding_box(aabb &box) const;
+    virtual float pdf_value(const vec3<float> &origin,
+                            const vec3<float> &direction) const;
+    virtual vec3<float> random(const vec3<float> &origin) const;
+
+    void set_uv(hit_record &rec) const
+    {
+        // The normal points in for a bubble's negative radius, the texture
+        // shouldn't turn inside out.
+        sphere_uv(mRadius < 0 ? -rec.normal : rec.normal, rec.u, rec.v);
+        rec.uv_scale = 1 / (2 * M_PI * fabs(mRadius));
+    }
+
     vec3<float> mCenter;
     float mRadius;
     material *mMaterial;
@@ -20,7 +47,6 @@ public:
 bool
 sphere::hit(const ray<float> &r, float tmin, float tmax, hit_record &rec) const
 {
-    rec.mat_ptr = mMaterial;
     vec3<float> oc = r.origin() - mCenter;
     float a = dot(r.direction(), r.direction());
     float b = 2.0 * dot(oc, r.direction());
@@ -34,6 +60,8 @@ sphere::hit(const ray<float> &r, float tmin, float tmax, hit_record &rec) const
             rec.t = temp;
             rec.p = r.point_at_parameter(rec.t);
             rec.normal = (rec.p - mCenter) / mRadius;
+            rec.mat_ptr = mMaterial;
+            set_uv(rec);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / (2.0*a);
@@ -41,8 +69,65 @@ sphere::hit(const ray<float> &r, float tmin, float tmax, hit_record &rec) const
             rec.t = temp;
             rec.p = r.point_at_parameter(rec.t);
             rec.normal = (rec.p - mCenter) / mRadius;
+            rec.mat_ptr = mMaterial;
+            set_uv(rec);
             return true;
         }
     }
     return false;
 }
+
+bool
+sphere::bounding_box(aabb &box) const
+{
+    // fabs: the inside of a bubble is modelled with a negative radius.
+    vec3<float> extent(fabs(mRadius), fabs(mRadius), fabs(mRadius));
+    box = aabb(mCenter - extent, mCenter + extent);
+    return true;
+}
+
+// Seen from outside, a sphere covers a cone of directions, with a half angle
+// of theta_max where sin(theta_max) = radius / distance.  Sampling that cone
+// uniformly has a constant pdf of 1 / solid angle.
+float
+sphere::pdf_value(const vec3<float> &origin, const vec3<float> &direction) const
+{
+    hit_record rec;
+    if (!hit(ray<float>(origin, direction), 0.001, FLT_MAX, rec)) {
+        return 0;
+    }
+    float distance_squared = (mCenter - origin).squared_length();
+    float radius_squared = mRadius * mRadius;
+    if (distance_squared <= radius_squared) {
+        // Inside the sphere, random() gives up and so do we.
+        return 0;
+    }
+    float cos_theta_max = sqrt(1 - radius_squared / distance_squared);
+    return 1 / (2 * M_PI * (1 - cos_theta_max));
+}
+
+vec3<float>
+sphere::random(const vec3<float> &origin) const
+{
+    vec3<float> w = mCenter - origin;
+    float distance_squared = w.squared_length();
+    float radius_squared = mRadius * mRadius;
+    if (distance_squared <= radius_squared) {
+        return w;
+    }
+    w = unit_vector(w);
+
+    // Uniform direction inside the cone around w.
+    float cos_theta_max = sqrt(1 - radius_squared / distance_squared);
+    float s, t;
+    random_float2(s, t);
+    float z = 1 + s * (cos_theta_max - 1);
+    float phi = 2 * M_PI * t;
+    float r = sqrt(1 - z*z);
+
+    // Any two vectors perpendicular to w and each other will do.
+    vec3<float> a = fabs(w.x()) > 0.9 ? vec3<float>(0, 1, 0) : vec3<float>(1, 0, 0);
+    vec3<float> v = unit_vector(cross(w, a));
+    vec3<float> u = cross(w, v);
+    return r * cos(phi) * u + r * sin(phi) * v + z * w;
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#include "hittable.h"
+#include "material.h"
+
+/* Position of M in the list of types that follows it. */
+template<typename M, typename... Types> struct type_index;
+
+template<typename M, typename... Rest>
+struct type_index<M, M, Rest...> : std::integral_constant<unsigned, 0> {};
+
+template<typename M, typename First, typename... Rest>
+struct type_index<M, First, Rest...> :
+    std::integral_constant<unsigned, 1 + type_index<M, Rest...>::value> {};
+
+/* Which material a primitive of a static_scene uses: the position of its type
+ * in the scene's material list, and its position in that type's array. */
+struct material_ref {
+    unsigned type;
+    unsigned index;
+};
+
+/* A scene whose primitive and material types are fixed at compile time, for
+ * scenes like random_scene() that only use a few of them.
+ *
+ * The primitives sit in one array and the materials in one array per type.
+ * The bvh is built the same way bvh_node builds it, but its nodes are held in
+ * an array and name their children by index.  Everything the integrator asks
+ * for is called on the concrete type (sphere::hit, lambertian::scatter...),
+ * so there are no virtual calls left for a ray to go through and the compiler
+ * can inline all of it.  trace() is instantiated on this just like on
+ * virtual_scene, the hittable/material version.
+ *
+ * The primitives' own material pointers are ignored: hit() reports the
+ * material as a material_ref instead.
+ *
+ * Primitives with no bounding box are left out of the bvh, like bvh_node
+ * leaves them out, and every ray tests them one by one. */
+template<typename Primitive, typename... Materials>
+class static_scene {
+public:
+    typedef material_ref material_handle;
+
+    template<typename M> material_ref add_material(const M &m)
+    {
+        const unsigned type = type_index<M, Materials...>::value;
+        std::vector<M> &materials = std::get<type_index<M, Materials...>::value>(m_materials);
+        materials.push_back(m);
+        material_ref ref = {type, unsigned(materials.size() - 1)};
+        return ref;
+    }
+
+    void add(const Primitive &primitive, material_ref material)
+    {
+        m_primitives.push_back(primitive);
+        m_primitive_materials.push_back(material);
+    }
+
+    // Copies the objects of a hittable scene, which all have to be Primitives
+    // with one of the Materials.  Returns false if one isn't.
+    bool add(const std::list<hittable*> &objects);
+
+    // Has to be called after the last add(), before hit().
+    void build();
+
+    size_t size() const {return m_primitives.size();}
+
+    bool hit(const ray<float> &r, float t_min, float t_max, hit_record &rec,
+             material_ref &material) const
+    {
+        bool hit_unbounded = false;
+        for (size_t i = 0; i < m_unbounded.size(); i++) {
+            if (m_primitives[m_unbounded[i]].Primitive::hit(r, t_min, t_max, rec)) {
+                material = m_primitive_materials[m_unbounded[i]];
+                hit_unbounded = true;
+                t_max = rec.t;
+            }
+        }
+        return (!m_nodes.empty() && hit_tree(r, t_min, t_max, rec, material))
+            || hit_unbounded;
+    }
+
+    bool scatter(material_ref m, const ray<float> &r_in, hit_record &rec,
+                 vec3<float> &attenuation, ray<float> &scattered) const
+    {
+        scatter_call call = {r_in, rec, attenuation, scattered, false};
+        dispatch(m, call, std::integral_constant<unsigned, 0>());
+        return call.result;
+    }
+
+    vec3<float> emitted(material_ref m, const hit_record &rec) const
+    {
+        emitted_call call = {rec, vec3<float>(0, 0, 0)};
+        dispatch(m, call, std::integral_constant<unsigned, 0>());
+        return call.result;
+    }
+
+    float scattering_pdf(material_ref m, const ray<float> &r_in,
+                         const hit_record &rec, const ray<float> &scattered) const
+    {
+        pdf_call call = {r_in, rec, scattered, 0};
+        dispatch(m, call, std::integral_constant<unsigned, 0>());
+        return call.result;
+    }
+
+private:
+    static const unsigned material_types = sizeof...(Materials);
+
+    // A child is a node index, or ~i for primitive i; m_right is 'none' for a
+    // leaf holding a single primitive.
+    struct node {
+        aabb box;
+        int left;
+        int right;
+    };
+    static const int none = 0x7fffffff;
+
+    // Only for primitives that have a box; build() leaves the others out.
+    aabb primitive_box(unsigned primitive) const
+    {
+        aabb box;
+        m_primitives[primitive].Primitive::bounding_box(box);
+        return box;
+    }
+    aabb child_box(int child) const
+    {
+        return child >= 0 ? m_nodes[child].box : primitive_box(~child);
+    }
+    int build(std::vector<unsigned> &order, size_t start, size_t end);
+
+    // Same order as bvh_node::hit(), left before right, but walked with a
+    // stack instead of recursion, and anything found so far narrows the
+    // boxes that are still worth testing.
+    bool hit_tree(const ray<float> &r, float t_min, float t_max, hit_record &rec,
+                  material_ref &material) const
+    {
+        // Median splits keep the tree balanced, so this is plenty.
+        int stack[64];
+        int depth = 0;
+        int child = 0;
+        bool hit_anything = false;
+        for (;;) {
+            if (child >= 0) {
+                const node &n = m_nodes[child];
+                if (n.box.hit(r, t_min, t_max)) {
+                    if (n.right != none) {
+                        stack[depth++] = n.right;
+                    }
+                    child = n.left;
+                    continue;
+                }
+            } else if (m_primitives[~child].Primitive::hit(r, t_min, t_max, rec)) {
+                material = m_primitive_materials[~child];
+                hit_anything = true;
+                t_max = rec.t;
+            }
+            if (depth == 0) {
+                return hit_anything;
+            }
+            child = stack[--depth];
+        }
+    }
+
+    // Calls 'call' on material 'm' as its concrete type.  The qualified calls
+    // (M::scatter rather than scatter) are what keep them from going through
+    // the vtable.
+    struct scatter_call {
+        const ray<float> &r_in;
+        hit_record &rec;
+        vec3<float> &attenuation;
+        ray<float> &scattered;
+        bool result;
+        template<typename M> void operator()(const M &m)
+        {
+            result = m.M::scatter(r_in, rec, attenuation, scattered);
+        }
+    };
+    struct emitted_call {
+        const hit_record &rec;
+        vec3<float> result;
+        template<typename M> void operator()(const M &m)
+        {
+            result = m.M::emitted(rec);
+        }
+    };
+    struct pdf_call {
+        const ray<float> &r_in;
+        const hit_record &rec;
+        const ray<float> &scattered;
+        float result;
+        template<typename M> void operator()(const M &m)
+        {
+            result = m.M::scattering_pdf(r_in, rec, scattered);
+        }
+    };
+
+    template<typename F, unsigned I>
+    void dispatch(material_ref m, F &call, std::integral_constant<unsigned, I>) const
+    {
+        if (m.type == I) {
+            call(std::get<I>(m_materials)[m.index]);
+        } else {
+            dispatch(m, call, std::integral_constant<unsigned, I + 1>());
+        }
+    }
+    template<typename F>
+    void dispatch(material_ref, F &, std::integral_constant<unsigned, material_types>) const
+    {}
+
+    // Copies 'm' if it's exactly one of the Materials, not just derived from
+    // one.
+    template<unsigned I>
+    bool copy_material(const material *m, material_ref &ref,
+                       std::integral_constant<unsigned, I>)
+    {
+        typedef typename std::tuple_element<I, std::tuple<Materials...> >::type type;
+        const type *typed = dynamic_cast<const type *>(m);
+        if (typed && typeid(*m) == typeid(type)) {
+            ref = add_material(*typed);
+            return true;
+        }
+        return copy_material(m, ref, std::integral_constant<unsigned, I + 1>());
+    }
+    bool copy_material(const material *, material_ref &,
+                       std::integral_constant<unsigned, material_types>)
+    {
+        return false;
+    }
+
+    std::vector<Primitive> m_primitives;
+    std::vector<material_ref> m_primitive_materials;
+    std::tuple<std::vector<Materials>...> m_materials;
+    std::vector<node> m_nodes;
+    // Primitives with no box, which aren't in the bvh.
+    std::vector<unsigned> m_unbounded;
+};
+
+template<typename Primitive, typename... Materials> bool
+static_scene<Primitive, Materials...>::add(const std::list<hittable*> &objects)
+{
+    // Objects that share a material keep sharing it.
+    std::map<const material *, material_ref> copied;
+    for (auto it = objects.begin(); it != objects.end(); it++) {
+        const Primitive *primitive = dynamic_cast<const Primitive *>(*it);
+        if (!primitive || typeid(**it) != typeid(Primitive)) {
+            std::cerr << "static_scene: object isn't a " << typeid(Primitive).name()
+                      << std::endl;
+            return false;
+        }
+
+        const material *m = primitive->mMaterial;
+        auto found = copied.find(m);
+        if (found == copied.end()) {
+            material_ref ref;
+            if (!m || !copy_material(m, ref, std::integral_constant<unsigned, 0>())) {
+                std::cerr << "static_scene: object has a material of a type the "
+                          << "scene doesn't hold" << std::endl;
+                return false;
+            }
+            found = copied.insert(std::make_pair(m, ref)).first;
+        }
+        add(*primitive, found->second);
+    }
+    return true;
+}
+
+template<typename Primitive, typename... Materials> void
+static_scene<Primitive, Materials...>::build()
+{
+    m_nodes.clear();
+    m_unbounded.clear();
+    std::vector<unsigned> order;
+    for (size_t i = 0; i < m_primitives.size(); i++) {
+        aabb box;
+        if (m_primitives[i].Primitive::bounding_box(box)) {
+            order.push_back(i);
+        } else {
+            m_unbounded.push_back(i);
+        }
+    }
+    if (order.empty()) {
+        return;
+    }
+    if (order.size() == 1) {
+        node leaf = {primitive_box(order[0]), ~int(order[0]), none};
+        m_nodes.push_back(leaf);
+        return;
+    }
+    build(order, 0, order.size());
+}
+
+// Splits like split_objects(), and returns the new node's index.
+template<typename Primitive, typename... Materials> int
+static_scene<Primitive, Materials...>::build(std::vector<unsigned> &order,
+                                             size_t start, size_t end)
+{
+    int index = m_nodes.size();
+    m_nodes.push_back(node());
+    size_t span = end - start;
+
+    aabb centroids(primitive_box(order[start]).centroid(),
+                   primitive_box(order[start]).centroid());
+    for (size_t i = start + 1; i < end; i++) {
+        vec3<float> c = primitive_box(order[i]).centroid();
+        centroids = surrounding_box(centroids, aabb(c, c));
+    }
+    int axis = centroids.longest_axis();
+    size_t mid = start + span / 2;
+    std::nth_element(order.begin() + start, order.begin() + mid,
+                     order.begin() + end, [&](unsigned a, unsigned b) {
+        return primitive_box(a).centroid()[axis] < primitive_box(b).centroid()[axis];
+    });
+
+    int left, right;
+    if (span == 2) {
+        left = ~int(order[start]);
+        right = ~int(order[start + 1]);
+    } else {
+        left = mid - start == 1 ? ~int(order[start]) : build(order, start, mid);
+        right = end - mid == 1 ? ~int(order[mid]) : build(order, mid, end);
+    }
+    node &n = m_nodes[index];
+    n.left = left;
+    n.right = right;
+    n.box = surrounding_box(child_box(left), child_box(right));
+    return index;
+}
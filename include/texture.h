@@ -0,0 +1,162 @@
+#pragma once
+
+#include <math.h>
+
+#include "hittable.h"
+#include "perlin.h"
+#include "texture_cache.h"
+#include "vec3.hpp"
+
+/* A color that varies over a surface, looked up where a ray hit it: by its
+ * surface coordinates (rec.u, rec.v), or by the point itself for textures
+ * that fill space.  rec.uv_width() says how much of the uv square the ray
+ * covers there, so a texture can average over that much instead of picking a
+ * single point out of detail smaller than a pixel. */
+class texture {
+public:
+    virtual ~texture() {}
+    virtual vec3<float> value(const hit_record &rec) const = 0;
+};
+
+class solid_color : public texture {
+public:
+    solid_color(const vec3<float> &color) : m_color(color) {}
+
+    virtual vec3<float> value(const hit_record &rec) const
+    {
+        return m_color;
+    }
+
+private:
+    vec3<float> m_color;
+};
+
+/* Alternates between two textures in 3D checks 'size' wide, so the pattern
+ * carries on through any surface rather than being stretched over it. */
+class checker_texture : public texture {
+public:
+    checker_texture(texture *even, texture *odd, float size = 1) :
+        m_even(even),
+        m_odd(odd),
+        m_inverse_size(1 / size)
+        {}
+
+    virtual vec3<float> value(const hit_record &rec) const
+    {
+        int x = int(floor(m_inverse_size * rec.p.x()));
+        int y = int(floor(m_inverse_size * rec.p.y()));
+        int z = int(floor(m_inverse_size * rec.p.z()));
+        return ((x + y + z) & 1) ? m_odd->value(rec) : m_even->value(rec);
+    }
+
+private:
+    texture *m_even;
+    texture *m_odd;
+    float m_inverse_size;
+};
+
+/* Marble: stripes along z, pushed around by Perlin turbulence. */
+class noise_texture : public texture {
+public:
+    noise_texture(float scale = 1, const vec3<float> &color = vec3<float>(1, 1, 1)) :
+        m_scale(scale),
+        m_color(color)
+        {}
+
+    virtual vec3<float> value(const hit_record &rec) const
+    {
+        float stripes = sin(m_scale * rec.p.z() + 10 * m_noise.turbulence(rec.p));
+        return 0.5f * (1 + stripes) * m_color;
+    }
+
+private:
+    perlin m_noise;
+    float m_scale;
+    vec3<float> m_color;
+};
+
+/* An image wrapped around the surface's (u, v), u repeating and v clamped to
+ * the edges.  Filtered trilinearly: bilinear within the two mip levels whose
+ * texel size is closest to the ray's footprint, blended between them. */
+class image_texture : public texture {
+public:
+    // 'image' is an id from cache.open().
+    image_texture(texture_cache &cache, int image) :
+        m_cache(cache),
+        m_image(image)
+        {}
+
+    virtual vec3<float> value(const hit_record &rec) const;
+
+private:
+    vec3<float> bilinear(int level, float u, float v) const;
+
+    texture_cache &m_cache;
+    int m_image;
+};
+
+vec3<float>
+image_texture::value(const hit_record &rec) const
+{
+    if (m_image < 0) {
+        // Couldn't open it: magenta, to stand out.
+        return vec3<float>(1, 0, 1);
+    }
+
+    // Texels the footprint covers on the full size image, which is 2^level
+    // at the right level.
+    int size = std::max(m_cache.width(m_image), m_cache.height(m_image));
+    float texels = rec.uv_width() * size;
+    float level = texels > 1 ? log2(texels) : 0;
+    int max_level = m_cache.levels(m_image) - 1;
+    if (level >= max_level) {
+        return bilinear(max_level, rec.u, rec.v);
+    }
+
+    int fine = int(level);
+    float blend = level - fine;
+    vec3<float> color = bilinear(fine, rec.u, rec.v);
+    if (blend > 0) {
+        color = (1 - blend) * color + blend * bilinear(fine + 1, rec.u, rec.v);
+    }
+    return color;
+}
+
+vec3<float>
+image_texture::bilinear(int level, float u, float v) const
+{
+    const int tile_size = texture_cache::tile_size;
+    int width = m_cache.width(m_image, level);
+    int height = m_cache.height(m_image, level);
+
+    // Texel centers are at half integers.  Row 0 is the top of the image,
+    // which is v = 1.
+    float x = (u - floor(u)) * width - 0.5f;
+    float y = (1 - std::max(0.0f, std::min(1.0f, v))) * height - 0.5f;
+    int x0 = int(floor(x));
+    int y0 = int(floor(y));
+    float fx = x - x0;
+    float fy = y - y0;
+
+    // The four texels are usually in the same tile, only look it up again
+    // when they aren't.
+    texture_cache::tile_ref t;
+    int t_x = -1, t_y = -1;
+    vec3<float> sum(0, 0, 0);
+    for (int dy = 0; dy < 2; dy++) {
+        int ty = std::max(0, std::min(height - 1, y0 + dy));
+        for (int dx = 0; dx < 2; dx++) {
+            int tx = x0 + dx;
+            tx = tx < 0 ? tx + width : tx >= width ? tx - width : tx;
+            if (!t || tx / tile_size != t_x || ty / tile_size != t_y) {
+                t_x = tx / tile_size;
+                t_y = ty / tile_size;
+                t.release();
+                t = m_cache.get(m_image, level, t_x, t_y);
+            }
+            float weight = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy);
+            sum += weight * t->texels[(ty % tile_size) * tile_size + tx % tile_size];
+        }
+    }
+    return sum;
+}
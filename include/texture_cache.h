@@ -0,0 +1,610 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vec3.hpp"
+
+/* Image textures, kept on disk and loaded a tile at a time.
+ *
+ * Each image has a chain of mip levels, each half the size of the one before,
+ * down to 1x1, and every level is cut into tile_size x tile_size tiles.  The
+ * first time an image is opened, all of that is worked out in one pass over
+ * the image and written next to it, to <image>.mip, tile by tile, so any tile
+ * of any level can be read with a single seek.  Tiles are only read when a
+ * lookup needs them, and the cache holds at most max_bytes of them, dropping
+ * the least recently used ones to make room.  So a scene can use many large
+ * textures while only the parts that rays actually look at, at the resolution
+ * they look at them, are in memory.
+ *
+ * Images are binary PPMs (P6).  Colors are converted to linear for
+ * filtering, the inverse of the sqrt gamma drawPixel() applies.
+ *
+ * One cache is meant to be shared by every texture and every thread.  So the
+ * threads don't all queue up on one lock for every texel they fetch, the
+ * tiles are split between shard_count shards by a hash of where they are,
+ * each with its own lock, its own least recently used order and an even
+ * share of max_bytes; neighbouring tiles land in different shards.  All the
+ * open() calls have to happen before rendering starts.
+ *
+ * Room for max_bytes of tiles, and the tables to find them, are set aside
+ * when the cache is made, and tiles are read through a file descriptor per
+ * image that stays open, so loading and dropping tiles while rendering
+ * doesn't allocate anything.  (The memory is only touched, and so only really
+ * used, as tiles are loaded into it.) */
+class texture_cache {
+public:
+    static const int tile_size = 32;
+    // A tile in the .mip file: 8 bit RGB, gamma encoded like the image.
+    static const int tile_bytes = tile_size * tile_size * 3;
+    static const int shard_count = 16;
+
+    struct tile {
+        vec3<float> texels[tile_size * tile_size];
+    };
+
+    /* A tile from get().  It isn't dropped from the cache, or its memory
+     * reused, while this still refers to it.  Release one before getting
+     * another: a thread waiting for room in a full shard mustn't be holding
+     * any, or two threads could each hold the tile the other needs gone. */
+    class tile_ref {
+    public:
+        tile_ref() : m_tile(nullptr), m_users(nullptr) {}
+        tile_ref(const tile_ref &) = delete;
+        tile_ref(tile_ref &&r) : m_tile(r.m_tile), m_users(r.m_users)
+        {
+            r.m_tile = nullptr;
+            r.m_users = nullptr;
+        }
+        ~tile_ref() {release();}
+
+        tile_ref &operator=(const tile_ref &) = delete;
+        tile_ref &operator=(tile_ref &&r)
+        {
+            if (this != &r) {
+                release();
+                m_tile = r.m_tile;
+                m_users = r.m_users;
+                r.m_tile = nullptr;
+                r.m_users = nullptr;
+            }
+            return *this;
+        }
+
+        explicit operator bool() const {return m_tile != nullptr;}
+        const tile *operator->() const {return m_tile;}
+
+        void release()
+        {
+            if (m_users) {
+                m_users->fetch_sub(1, std::memory_order_release);
+            }
+            m_tile = nullptr;
+            m_users = nullptr;
+        }
+
+    private:
+        friend class texture_cache;
+        tile_ref(const tile *t, std::atomic<int> *users) : m_tile(t), m_users(users) {}
+
+        const tile *m_tile;
+        std::atomic<int> *m_users;
+    };
+
+    texture_cache(size_t max_bytes = 64 << 20);
+    ~texture_cache();
+
+    // Opens the PPM at 'path', writing its .mip file first if that isn't
+    // there or is out of date.  Returns its id, or -1 if it can't be used.
+    int open(const std::string &path);
+
+    int width(int id, int level = 0) const {return width_at(m_images[id], level);}
+    int height(int id, int level = 0) const {return height_at(m_images[id], level);}
+    int levels(int id) const {return m_images[id].levels;}
+
+    // The tile holding texel (x, y) of a level is number
+    // (x / tile_size, y / tile_size).
+    tile_ref get(int id, int level, int tile_x, int tile_y);
+
+    size_t bytes() const;
+    // How many tiles have been read, including ones read again after being
+    // dropped.
+    size_t loads() const;
+
+private:
+    struct image_file {
+        std::string tiled_path;
+        // Open for as long as the cache is.
+        int fd;
+        int width;
+        int height;
+        int levels;
+        // Where each level's tiles start in the .mip file.
+        std::vector<std::streamoff> level_offsets;
+    };
+
+    static int width_at(const image_file &image, int level)
+    {
+        return std::max(1, image.width >> level);
+    }
+    static int height_at(const image_file &image, int level)
+    {
+        return std::max(1, image.height >> level);
+    }
+
+    struct key {
+        int id;
+        int level;
+        int tile_x;
+        int tile_y;
+
+        bool operator==(const key &k) const
+        {
+            return id == k.id && level == k.level && tile_x == k.tile_x
+                && tile_y == k.tile_y;
+        }
+
+        unsigned hash() const
+        {
+            unsigned h = unsigned(id) * 2654435761u ^ unsigned(level) * 40503u
+                       ^ unsigned(tile_x) * 73856093u ^ unsigned(tile_y) * 19349663u;
+            return h ^ h >> 16;
+        }
+    };
+
+    // Where a tile can go.  Slot i holds its tile in m_tiles[i].
+    struct slot {
+        slot() : in_use(false), loading(false), users(0), next(-1), newer(-1), older(-1) {}
+
+        key k;
+        // Holding the tile for 'k', or about to once 'loading' is over.
+        bool in_use;
+        bool loading;
+        // tile_refs to it.  Only goes up with the shard locked, so with the
+        // lock held, zero means it can be reused.
+        std::atomic<int> users;
+        // The next slot in the same hash bucket, or the next free one.
+        int next;
+        // Neighbours in the shard's least recently used order.
+        int newer;
+        int older;
+    };
+
+    struct shard {
+        shard() : newest(-1), oldest(-1), free(-1), used(0), loads(0) {}
+
+        mutable std::mutex mutex;
+        // Signalled when a tile finishes loading.
+        std::condition_variable loaded;
+        // First slot in each bucket, by key hash; a power of two long.
+        std::vector<int> buckets;
+        int newest;
+        int oldest;
+        int free;
+        size_t used;
+        size_t loads;
+    };
+
+    shard &shard_for(const key &k) {return m_shards[k.hash() % shard_count];}
+    int &bucket_for(shard &s, const key &k)
+    {
+        return s.buckets[(k.hash() / shard_count) & (s.buckets.size() - 1)];
+    }
+
+    // The slot holding 'k' in 's', or -1.
+    int find(shard &s, const key &k);
+    // A slot in 's' to load a new tile into, emptied: a free one, or the
+    // least recently used one nobody is using.  -1 if there isn't one.
+    int take_slot(shard &s);
+    void unlink(shard &s, int i);
+    void make_newest(shard &s, int i);
+
+    void read_tile(const key &k, tile &t);
+
+    size_t m_max_bytes;
+    // Only changed by open(), before rendering, so lookups don't lock it.
+    std::mutex m_mutex;
+    std::vector<image_file> m_images;
+    std::unique_ptr<slot[]> m_slots;
+    std::unique_ptr<tile[]> m_tiles;
+    shard m_shards[shard_count];
+};
+
+inline int
+tiles_across(int texels)
+{
+    return (texels + texture_cache::tile_size - 1) / texture_cache::tile_size;
+}
+
+inline unsigned char
+encode_texel(float linear)
+{
+    return (unsigned char)(std::min(1.0f, sqrt(linear)) * 255 + 0.5f);
+}
+
+/* One mip level while an image is being converted: rows come in top to
+ * bottom, collect in a band until there are enough for a row of tiles, and
+ * are averaged in pairs into the rows of the next level. */
+class mip_level_writer {
+public:
+    mip_level_writer(int width, int height, std::streamoff offset) :
+        m_width(width),
+        m_height(height),
+        m_offset(offset),
+        m_band(texture_cache::tile_size * width * 3),
+        m_pending(width)
+        {}
+
+    // Row 'y' of this level, in linear color.  Returns true if there's a row
+    // for the next level, 'y' / 2, in 'next' (which is next_width wide).
+    bool add_row(std::ostream &out, const std::vector<vec3<float> > &row, int y,
+                 int next_width, int next_height, std::vector<vec3<float> > &next)
+    {
+        const int tile_size = texture_cache::tile_size;
+        unsigned char *band_row = &m_band[(y % tile_size) * m_width * 3];
+        for (int x = 0; x < m_width; x++) {
+            for (int c = 0; c < 3; c++) {
+                band_row[x*3 + c] = encode_texel(row[x][c]);
+            }
+        }
+        if (y % tile_size == tile_size - 1 || y == m_height - 1) {
+            write_band(out, y / tile_size, y % tile_size + 1);
+        }
+
+        if (y % 2 == 0 && y < m_height - 1) {
+            m_pending = row;
+            return false;
+        }
+        // An odd height leaves the last row without a partner; it's only
+        // used if the next level is as tall as this one (both 1).
+        const std::vector<vec3<float> > &above = y % 2 ? m_pending : row;
+        if (y / 2 >= next_height) {
+            return false;
+        }
+        next.resize(next_width);
+        for (int x = 0; x < next_width; x++) {
+            int x1 = std::min(2*x + 1, m_width - 1);
+            next[x] = 0.25f * (above[2*x] + above[x1] + row[2*x] + row[x1]);
+        }
+        return true;
+    }
+
+private:
+    // Cuts the band into tiles and writes them out, repeating the last row
+    // and column into any part of a tile past the edge of the image, so
+    // filtering near the edge doesn't pull in black.
+    void write_band(std::ostream &out, int tile_y, int rows)
+    {
+        const int tile_size = texture_cache::tile_size;
+        int tiles_x = tiles_across(m_width);
+        unsigned char tile[texture_cache::tile_bytes];
+        for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+            for (int y = 0; y < tile_size; y++) {
+                const unsigned char *band_row = &m_band[std::min(y, rows - 1) * m_width * 3];
+                for (int x = 0; x < tile_size; x++) {
+                    int source_x = std::min(tile_x * tile_size + x, m_width - 1);
+                    std::copy(band_row + source_x*3, band_row + source_x*3 + 3,
+                              tile + (y * tile_size + x) * 3);
+                }
+            }
+            out.seekp(m_offset + (std::streamoff(tile_y) * tiles_x + tile_x)
+                      * texture_cache::tile_bytes);
+            out.write(reinterpret_cast<const char *>(tile), texture_cache::tile_bytes);
+        }
+    }
+
+    int m_width;
+    int m_height;
+    std::streamoff m_offset;
+    std::vector<unsigned char> m_band;
+    std::vector<vec3<float> > m_pending;
+};
+
+/* Writes the tiled mip levels of the image in 'in' to 'tiled_path', keeping
+ * only a band of rows per level in memory. */
+inline bool
+write_tiled_mips(std::istream &in, const std::string &tiled_path, int width,
+                 int height, const std::vector<std::streamoff> &level_offsets)
+{
+    std::ofstream out(tiled_path.c_str(), std::ios::binary | std::ios::trunc);
+    out << "MIP " << width << " " << height << " " << level_offsets.size() << "\n";
+    if (!out) {
+        return false;
+    }
+
+    int levels = level_offsets.size();
+    std::vector<mip_level_writer> writers;
+    for (int l = 0; l < levels; l++) {
+        writers.push_back(mip_level_writer(std::max(1, width >> l),
+                                           std::max(1, height >> l),
+                                           level_offsets[l]));
+    }
+
+    std::vector<unsigned char> bytes(width * 3);
+    std::vector<vec3<float> > row(width), next;
+    for (int y = 0; y < height; y++) {
+        if (!in.read(reinterpret_cast<char *>(&bytes[0]), bytes.size())) {
+            return false;
+        }
+        for (int x = 0; x < width; x++) {
+            vec3<float> c(bytes[x*3] / 255.0f, bytes[x*3 + 1] / 255.0f,
+                          bytes[x*3 + 2] / 255.0f);
+            row[x] = c * c;
+        }
+        // Each level's row may make a row for the level after it.
+        int level_y = y;
+        for (int l = 0; l < levels; l++, level_y /= 2) {
+            int next_height = l + 1 < levels ? std::max(1, height >> (l+1)) : 0;
+            if (!writers[l].add_row(out, row, level_y, std::max(1, width >> (l+1)),
+                                    next_height, next)) {
+                break;
+            }
+            row.swap(next);
+        }
+        row.resize(width);
+    }
+    return bool(out);
+}
+
+texture_cache::texture_cache(size_t max_bytes) :
+    m_max_bytes(max_bytes)
+{
+    // At least one tile per shard, however small max_bytes is.
+    size_t shard_tiles = std::max(size_t(1), max_bytes / sizeof(tile) / shard_count);
+    m_slots.reset(new slot[shard_tiles * shard_count]);
+    m_tiles.reset(new tile[shard_tiles * shard_count]);
+    size_t buckets = 1;
+    while (buckets < 2 * shard_tiles) {
+        buckets *= 2;
+    }
+    for (int i = 0; i < shard_count; i++) {
+        shard &s = m_shards[i];
+        s.buckets.assign(buckets, -1);
+        // Shard i has slots i * shard_tiles on, all free to start with.
+        int first = i * shard_tiles;
+        for (int j = 0; j < int(shard_tiles); j++) {
+            m_slots[first + j].next = j + 1 < int(shard_tiles) ? first + j + 1 : -1;
+        }
+        s.free = first;
+    }
+}
+
+texture_cache::~texture_cache()
+{
+    for (size_t i = 0; i < m_images.size(); i++) {
+        close(m_images[i].fd);
+    }
+}
+
+int
+texture_cache::open(const std::string &path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string magic;
+    int max_value;
+    image_file image;
+    if (!(in >> magic >> image.width >> image.height >> max_value)
+        || magic != "P6" || max_value != 255 || image.width <= 0 || image.height <= 0) {
+        std::cerr << path << ": not a binary 8-bit PPM (P6)" << std::endl;
+        return -1;
+    }
+    // Exactly one whitespace character after the header.
+    in.get();
+
+    image.levels = 1;
+    while ((std::max(image.width, image.height) >> image.levels) > 0) {
+        image.levels++;
+    }
+    std::ostringstream header;
+    header << "MIP " << image.width << " " << image.height << " " << image.levels << "\n";
+    std::streamoff offset = header.str().size();
+    for (int l = 0; l < image.levels; l++) {
+        image.level_offsets.push_back(offset);
+        offset += std::streamoff(tiles_across(width_at(image, l)))
+                * tiles_across(height_at(image, l)) * tile_bytes;
+    }
+
+    // Reuse the tiles from last time if they're newer than the image and
+    // all there.
+    image.tiled_path = path + ".mip";
+    struct stat image_stat, tiled_stat;
+    std::string tiled_header;
+    std::ifstream tiled(image.tiled_path.c_str(), std::ios::binary);
+    std::getline(tiled, tiled_header);
+    tiled.close();
+    if (stat(path.c_str(), &image_stat) != 0
+        || stat(image.tiled_path.c_str(), &tiled_stat) != 0
+        || tiled_stat.st_mtime < image_stat.st_mtime
+        || tiled_stat.st_size != offset
+        || tiled_header + "\n" != header.str()) {
+        std::cerr << path << ": writing mip levels to " << image.tiled_path << std::endl;
+        if (!write_tiled_mips(in, image.tiled_path, image.width, image.height,
+                              image.level_offsets)) {
+            std::cerr << image.tiled_path << ": couldn't write" << std::endl;
+            return -1;
+        }
+    }
+    image.fd = ::open(image.tiled_path.c_str(), O_RDONLY);
+    if (image.fd < 0) {
+        std::cerr << image.tiled_path << ": couldn't open" << std::endl;
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_images.push_back(image);
+    return m_images.size() - 1;
+}
+
+texture_cache::tile_ref
+texture_cache::get(int id, int level, int tile_x, int tile_y)
+{
+    key k = {id, level, tile_x, tile_y};
+    shard &s = shard_for(k);
+    std::unique_lock<std::mutex> lock(s.mutex);
+    int i;
+    for (;;) {
+        i = find(s, k);
+        if (i >= 0) {
+            if (m_slots[i].loading) {
+                // Someone else is reading it; use theirs.
+                s.loaded.wait(lock);
+                continue;
+            }
+            m_slots[i].users++;
+            make_newest(s, i);
+            return tile_ref(&m_tiles[i], &m_slots[i].users);
+        }
+        i = take_slot(s);
+        if (i >= 0) {
+            break;
+        }
+        // Every tile in the shard is being used right now.  They're only
+        // held for a few texel reads, so one will be free again soon.
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+
+    // Claim the slot for 'k' before reading, so another thread wanting the
+    // same tile waits for this one instead of reading it again.  The read
+    // happens without the lock, so other threads can carry on.
+    slot &sl = m_slots[i];
+    sl.k = k;
+    sl.in_use = true;
+    sl.loading = true;
+    sl.users++;
+    int &bucket = bucket_for(s, k);
+    sl.next = bucket;
+    bucket = i;
+    make_newest(s, i);
+    s.used++;
+    s.loads++;
+    lock.unlock();
+
+    read_tile(k, m_tiles[i]);
+
+    lock.lock();
+    sl.loading = false;
+    s.loaded.notify_all();
+    return tile_ref(&m_tiles[i], &sl.users);
+}
+
+int
+texture_cache::find(shard &s, const key &k)
+{
+    int i = bucket_for(s, k);
+    while (i >= 0 && !(m_slots[i].k == k)) {
+        i = m_slots[i].next;
+    }
+    return i;
+}
+
+int
+texture_cache::take_slot(shard &s)
+{
+    if (s.free >= 0) {
+        int i = s.free;
+        s.free = m_slots[i].next;
+        return i;
+    }
+    int i = s.oldest;
+    while (i >= 0 && m_slots[i].users.load(std::memory_order_acquire) > 0) {
+        i = m_slots[i].newer;
+    }
+    if (i < 0) {
+        return -1;
+    }
+
+    slot &sl = m_slots[i];
+    int *link = &bucket_for(s, sl.k);
+    while (*link != i) {
+        link = &m_slots[*link].next;
+    }
+    *link = sl.next;
+    unlink(s, i);
+    sl.in_use = false;
+    s.used--;
+    return i;
+}
+
+void
+texture_cache::unlink(shard &s, int i)
+{
+    slot &sl = m_slots[i];
+    (sl.newer >= 0 ? m_slots[sl.newer].older : s.newest) = sl.older;
+    (sl.older >= 0 ? m_slots[sl.older].newer : s.oldest) = sl.newer;
+    sl.newer = sl.older = -1;
+}
+
+void
+texture_cache::make_newest(shard &s, int i)
+{
+    if (s.newest == i) {
+        return;
+    }
+    slot &sl = m_slots[i];
+    if (sl.newer >= 0) {
+        unlink(s, i);
+    }
+    sl.older = s.newest;
+    if (s.newest >= 0) {
+        m_slots[s.newest].newer = i;
+    }
+    s.newest = i;
+    if (s.oldest < 0) {
+        s.oldest = i;
+    }
+}
+
+size_t
+texture_cache::bytes() const
+{
+    size_t total = 0;
+    for (int i = 0; i < shard_count; i++) {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        total += m_shards[i].used * sizeof(tile);
+    }
+    return total;
+}
+
+size_t
+texture_cache::loads() const
+{
+    size_t total = 0;
+    for (int i = 0; i < shard_count; i++) {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        total += m_shards[i].loads;
+    }
+    return total;
+}
+
+void
+texture_cache::read_tile(const key &k, tile &t)
+{
+    const image_file &image = m_images[k.id];
+    unsigned char bytes[tile_bytes];
+    off_t offset = image.level_offsets[k.level]
+                 + (std::streamoff(k.tile_y) * tiles_across(width(k.id, k.level)) + k.tile_x)
+                 * tile_bytes;
+    if (pread(image.fd, bytes, tile_bytes, offset) != tile_bytes) {
+        std::cerr << image.tiled_path << ": truncated" << std::endl;
+        std::fill(bytes, bytes + tile_bytes, 0);
+    }
+    for (int i = 0; i < tile_size * tile_size; i++) {
+        vec3<float> c(bytes[i*3] / 255.0f, bytes[i*3 + 1] / 255.0f, bytes[i*3 + 2] / 255.0f);
+        t.texels[i] = c * c;
+    }
+}
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <iostream>
 
+#include "sampler.h"
+
 template <typename T = float> class vec3
 {
 public:
@@ -256,13 +258,27 @@ refract(const vec3<T> &uv, const vec3<T> &n, T etai_over_etat)
     return r_out_perpendicular + r_out_parallel;
 }
 
+/**
+ * Uniform random point in the unit disk, using Shirley and Chiu's concentric
+ * mapping from the square so that stratified samples stay stratified.
+ */
 template<typename T> inline vec3<T>
 random_in_unit_disk()
 {
-    vec3<T> p;
-    do {
-        // TODO fix calls to drand48, use a thread local seed
-        p = (T)2.0 * vec3<T>(drand48(), drand48(), 0) - vec3<T>(1, 1, 0);
-    } while (dot(p,p) >= 1);
-    return p;
+    float a, b;
+    random_float2(a, b);
+    a = 2*a - 1;
+    b = 2*b - 1;
+    if (a == 0 && b == 0) {
+        return vec3<T>(0, 0, 0);
+    }
+    T r, theta;
+    if (fabs(a) > fabs(b)) {
+        r = a;
+        theta = (M_PI/4) * (b/a);
+    } else {
+        r = b;
+        theta = (M_PI/2) - (M_PI/4) * (a/b);
+    }
+    return vec3<T>(r * cos(theta), r * sin(theta), 0);
 }
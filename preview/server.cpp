@@ -0,0 +1,532 @@
+// Live preview server: renders random_scene() progressively and serves the
+// frames over HTTP on localhost, so camera setups can be tuned without
+// editing scene1/scene.cpp and waiting for a full render each time.
+//
+//   GET /view?lookfrom=13,2,3&lookat=0,0,0&vfov=20&aperture=0.1&focus=10
+//            &width=600&height=400&spp=256
+//       Change any of the view settings.  Tiles still being rendered for the
+//       old settings are abandoned and accumulation starts over.  Width and
+//       height go up to 8192 and spp to 65536, vfov has to be between 0 and
+//       180, the aperture can't be negative, the focus distance has to be
+//       positive and lookfrom can't be lookat; anything else is a 400, and
+//       nothing changes.
+//   GET /frame[?after=N]
+//       The latest frame as a binary PPM.  With 'after', waits for a frame
+//       newer than sequence number N, and answers 204 No Content if there
+//       isn't one within 30 seconds (because the render is finished, say).
+//   GET /stream
+//       Every new frame as it comes out, as multipart/x-mixed-replace.
+//
+// Each change is rendered at 1/8, 1/4 and 1/2 resolution first, one sample
+// per pixel, then at full resolution with the samples doubling every pass.
+// Frames carry X-Sequence, X-Generation (bumped by every change), X-Samples
+// and X-Latency-Ms: the time from the change to the first frame rendered
+// with it, which is also logged on stderr.
+//
+// usage: server [port]
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "camera.h"
+#include "integrator.h"
+#include "render.h"
+#include "render_workers.h"
+#include "sampler.h"
+#include "scenes.h"
+
+typedef std::chrono::steady_clock preview_clock;
+
+struct view_settings {
+    view_settings() :
+        lookfrom(13, 2, 3),
+        lookat(0, 0, 0),
+        vfov(20),
+        aperture(0.1),
+        focus_distance(10),
+        width(600),
+        height(400),
+        max_samples(256)
+        {}
+
+    vec3<> lookfrom;
+    vec3<> lookat;
+    float vfov;
+    float aperture;
+    float focus_distance;
+    int width;
+    int height;
+    int max_samples;
+};
+
+struct frame {
+    frame() : sequence(0), generation(0), width(0), height(0), samples(0),
+              latency_ms(0) {}
+
+    std::string ppm;
+    unsigned sequence;
+    unsigned generation;
+    int width;
+    int height;
+    int samples;
+    double latency_ms;
+};
+
+class preview_renderer {
+public:
+    static const int tile_size = 16;
+
+    preview_renderer(const hittable &world, const scene_lights &lights) :
+        m_world(world),
+        m_lights(lights),
+        m_generation(1),
+        m_changed_at(preview_clock::now()),
+        m_workers(std::max(1u, std::thread::hardware_concurrency()))
+        {}
+
+    // Calls change(settings) on a copy of the settings, with the lock held
+    // so changes made at the same time don't undo each other, and keeps the
+    // result if it returns true.  Returns the new generation number, or 0 if
+    // it didn't.
+    template<typename Change> unsigned update(Change change)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        view_settings settings = m_settings;
+        if (!change(settings)) {
+            return 0;
+        }
+        m_settings = settings;
+        m_changed_at = preview_clock::now();
+        m_settings_changed.notify_all();
+        return ++m_generation;
+    }
+
+    // Sets 'out' to the latest frame with a sequence number past 'after',
+    // waiting up to 'timeout' for one if need be.  Returns false if there
+    // wasn't one in time: once a view has all its samples, no more come.
+    template<typename Duration>
+    bool next_frame(unsigned after, Duration timeout, frame &out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_frame_ready.wait_for(lock, timeout,
+                                    [this, after]() {return m_frame.sequence > after;})) {
+            return false;
+        }
+        out = m_frame;
+        return true;
+    }
+
+    // Renders forever, starting over whenever the settings change.
+    void run();
+
+private:
+    bool render_pass(const camera &cam, unsigned generation, int nx, int ny,
+                     int first_sample, int samples);
+    void publish(unsigned generation, int nx, int ny, int samples);
+
+    const hittable &m_world;
+    const scene_lights &m_lights;
+
+    std::mutex m_mutex;
+    std::condition_variable m_settings_changed;
+    std::condition_variable m_frame_ready;
+    view_settings m_settings;
+    // Workers compare this with the generation they're rendering between
+    // rows, and give up as soon as it changes.
+    std::atomic<unsigned> m_generation;
+    preview_clock::time_point m_changed_at;
+    frame m_frame;
+
+    // Only used by run()'s thread.  They're kept from pass to pass and
+    // change to change, so once they've grown to the largest view, rendering
+    // doesn't allocate.
+    render_workers m_workers;
+    // Sum of the samples so far of every pixel, top row first.
+    std::vector<vec3<> > m_sums;
+    // The next frame's PPM, swapped with the published one's, so each buffer
+    // gets reused every other frame.
+    std::string m_ppm;
+};
+
+void
+preview_renderer::run()
+{
+    unsigned rendered = 0;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_settings_changed.wait(lock, [this, rendered]() {
+            return m_generation != rendered;
+        });
+        unsigned generation = m_generation;
+        view_settings v = m_settings;
+        lock.unlock();
+        rendered = generation;
+
+        camera cam(v.lookfrom, v.lookat, vec3<>(0, 1, 0), v.vfov,
+                   float(v.width) / float(v.height), v.aperture, v.focus_distance);
+
+        // Rough versions first, so there's something to look at right away.
+        bool cancelled = false;
+        for (int scale = 8; scale > 1 && !cancelled; scale /= 2) {
+            int nx = std::max(1, v.width / scale);
+            int ny = std::max(1, v.height / scale);
+            m_sums.assign(nx * ny, vec3<>(0, 0, 0));
+            cancelled = !render_pass(cam, generation, nx, ny, 0, 1);
+            if (!cancelled) {
+                publish(generation, nx, ny, 1);
+            }
+        }
+
+        m_sums.assign(v.width * v.height, vec3<>(0, 0, 0));
+        int done = 0;
+        for (int batch = 1; !cancelled && done < v.max_samples; batch *= 2) {
+            batch = std::min(batch, v.max_samples - done);
+            cancelled = !render_pass(cam, generation, v.width, v.height,
+                                     done, batch);
+            if (!cancelled) {
+                done += batch;
+                publish(generation, v.width, v.height, done);
+            }
+        }
+    }
+}
+
+// Adds samples [first_sample, first_sample + samples) of every pixel to
+// m_sums.  Returns false if the settings changed before it finished.
+bool
+preview_renderer::render_pass(const camera &cam, unsigned generation,
+                              int nx, int ny, int first_sample, int samples)
+{
+    int tiles_x = (nx + tile_size - 1) / tile_size;
+    int tiles_y = (ny + tile_size - 1) / tile_size;
+    int tile_count = tiles_x * tiles_y;
+    std::atomic<int> next_tile(0);
+
+    auto job = [&](unsigned) {
+        sobol_sampler pixel_sampler(first_sample + samples);
+        for (int tile = next_tile++; tile < tile_count; tile = next_tile++) {
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (tile / tiles_x) * tile_size;
+            for (int y = y0; y < std::min(y0 + tile_size, ny); y++) {
+                if (m_generation != generation) {
+                    current_sampler() = nullptr;
+                    return;
+                }
+                for (int x = x0; x < std::min(x0 + tile_size, nx); x++) {
+                    // Row 0 of the image is the top, but j = 0 is the bottom
+                    // of the camera's view.
+                    m_sums[y*nx + x] += trace_pixel(cam, m_world, m_lights,
+                                                    pixel_sampler, x, ny-1 - y,
+                                                    nx, ny, first_sample, samples);
+                }
+            }
+        }
+        current_sampler() = nullptr;
+    };
+    m_workers.start(job);
+    m_workers.wait();
+    return m_generation == generation;
+}
+
+void
+preview_renderer::publish(unsigned generation, int nx, int ny, int samples)
+{
+    char header[64];
+    size_t offset = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", nx, ny);
+    m_ppm.resize(offset + m_sums.size() * 3);
+    std::copy(header, header + offset, m_ppm.begin());
+    for (size_t i = 0; i < m_sums.size(); i++) {
+        vec3<> col = m_sums[i] / float(samples);
+        for (int c = 0; c < 3; c++) {
+            m_ppm[offset + 3*i + c] = char(int(255.99 * fmin(sqrt(col[c]), 1.0)));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (generation != m_generation) {
+        return;
+    }
+    bool first = m_frame.generation != generation;
+    if (first) {
+        m_frame.latency_ms = std::chrono::duration<double, std::milli>(
+            preview_clock::now() - m_changed_at).count();
+        std::cerr << "generation " << generation << ": first frame ("
+                  << nx << "x" << ny << ") " << m_frame.latency_ms
+                  << " ms after the change" << std::endl;
+    }
+    m_frame.ppm.swap(m_ppm);
+    m_frame.sequence++;
+    m_frame.generation = generation;
+    m_frame.width = nx;
+    m_frame.height = ny;
+    m_frame.samples = samples;
+    m_frame_ready.notify_all();
+}
+
+/// HTTP
+
+bool
+send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// Value of 'key' in a "a=1&b=2" query string, or "" if it isn't there.
+std::string
+query_value(const std::string &query, const std::string &key)
+{
+    std::istringstream in(query);
+    std::string pair;
+    while (std::getline(in, pair, '&')) {
+        size_t eq = pair.find('=');
+        if (eq != std::string::npos && pair.substr(0, eq) == key) {
+            return pair.substr(eq + 1);
+        }
+    }
+    return "";
+}
+
+// Sets 'out' from the query value for 'key', if there is one.  Returns false
+// if it isn't three numbers separated by commas.
+bool
+parse_vec3(const std::string &query, const char *key, vec3<> &out)
+{
+    std::string text = query_value(query, key);
+    if (text.empty()) {
+        return true;
+    }
+    float x, y, z;
+    int length = 0;
+    if (sscanf(text.c_str(), "%f,%f,%f%n", &x, &y, &z, &length) != 3
+        || size_t(length) != text.size()
+        || !std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+        return false;
+    }
+    out = vec3<>(x, y, z);
+    return true;
+}
+
+// Sets 'out' from the query value for 'key', if there is one.  Returns false
+// if it isn't a number.
+bool
+parse_float(const std::string &query, const char *key, float &out)
+{
+    std::string text = query_value(query, key);
+    if (text.empty()) {
+        return true;
+    }
+    char *end;
+    float value = strtof(text.c_str(), &end);
+    if (*end != '\0' || !std::isfinite(value)) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+// Limits on what /view accepts, so a typo can't ask for more memory than
+// there is (or more pixels than fit in an int).
+const int max_view_size = 8192;
+const int max_view_samples = 65536;
+
+// Sets 'out' from the query value for 'key', if there is one.  Returns false
+// if it isn't a whole number in [min, max].
+bool
+parse_bounded(const std::string &query, const char *key, int min, int max, int &out)
+{
+    std::string text = query_value(query, key);
+    if (text.empty()) {
+        return true;
+    }
+    char *end;
+    long value = strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || value < min || value > max) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+// Applies a /view query to 'v'.  Returns what's wrong with it, or "" if
+// nothing is.
+std::string
+apply_view_query(const std::string &query, view_settings &v)
+{
+    std::ostringstream error;
+    if (!parse_vec3(query, "lookfrom", v.lookfrom)
+        || !parse_vec3(query, "lookat", v.lookat)) {
+        error << "lookfrom and lookat are x,y,z\n";
+    } else if ((v.lookfrom - v.lookat).squared_length() == 0) {
+        error << "lookfrom and lookat can't be the same point\n";
+    }
+    if (!parse_float(query, "vfov", v.vfov) || v.vfov <= 0 || v.vfov >= 180) {
+        error << "vfov is in degrees, more than 0 and less than 180\n";
+    }
+    if (!parse_float(query, "aperture", v.aperture) || v.aperture < 0) {
+        error << "aperture can't be negative\n";
+    }
+    if (!parse_float(query, "focus", v.focus_distance) || v.focus_distance <= 0) {
+        error << "focus has to be more than 0\n";
+    }
+    if (!parse_bounded(query, "width", 1, max_view_size, v.width)
+        || !parse_bounded(query, "height", 1, max_view_size, v.height)
+        || !parse_bounded(query, "spp", 1, max_view_samples, v.max_samples)) {
+        error << "width and height go from 1 to " << max_view_size
+              << ", spp from 1 to " << max_view_samples << "\n";
+    }
+    return error.str();
+}
+
+// True if the other end has closed the connection.
+bool
+client_gone(int fd)
+{
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+std::string
+frame_headers(const frame &f)
+{
+    std::ostringstream out;
+    out << "Content-Type: image/x-portable-pixmap\r\n"
+        << "Content-Length: " << f.ppm.size() << "\r\n"
+        << "X-Sequence: " << f.sequence << "\r\n"
+        << "X-Generation: " << f.generation << "\r\n"
+        << "X-Samples: " << f.samples << "\r\n"
+        << "X-Latency-Ms: " << f.latency_ms << "\r\n";
+    return out.str();
+}
+
+void
+handle_connection(int fd, preview_renderer &renderer)
+{
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 65536) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        request.append(buffer, n);
+    }
+
+    std::istringstream line(request);
+    std::string method, target;
+    line >> method >> target;
+    size_t question = target.find('?');
+    std::string path = target.substr(0, question);
+    std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+
+    if (path == "/view") {
+        // Applied to the settings as they are when the renderer has the lock,
+        // so it only changes what's in the query.
+        std::string error;
+        unsigned generation = renderer.update([&](view_settings &v) {
+            error = apply_view_query(query, v);
+            return error.empty();
+        });
+        if (!generation) {
+            send_all(fd, "HTTP/1.0 400 Bad Request\r\nContent-Type: text/plain\r\n\r\n"
+                         + error);
+            close(fd);
+            return;
+        }
+
+        std::ostringstream body;
+        body << "generation " << generation << "\n";
+        send_all(fd, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n" + body.str());
+    } else if (path == "/frame") {
+        frame f;
+        if (renderer.next_frame(strtoul(query_value(query, "after").c_str(), nullptr, 10),
+                                std::chrono::seconds(30), f)) {
+            send_all(fd, "HTTP/1.0 200 OK\r\n" + frame_headers(f) + "\r\n")
+                && send_all(fd, f.ppm);
+        } else {
+            send_all(fd, "HTTP/1.0 204 No Content\r\n\r\n");
+        }
+    } else if (path == "/stream") {
+        const std::string boundary = "frame";
+        bool ok = send_all(fd, "HTTP/1.0 200 OK\r\nContent-Type: "
+                               "multipart/x-mixed-replace; boundary=" + boundary + "\r\n\r\n");
+        for (unsigned sequence = 0; ok; ) {
+            // Nothing new comes once the view has all its samples, so check
+            // every so often that someone is still watching.
+            frame f;
+            if (!renderer.next_frame(sequence, std::chrono::seconds(5), f)) {
+                ok = !client_gone(fd);
+                continue;
+            }
+            sequence = f.sequence;
+            ok = send_all(fd, "--" + boundary + "\r\n" + frame_headers(f) + "\r\n")
+              && send_all(fd, f.ppm) && send_all(fd, "\r\n");
+        }
+    } else {
+        send_all(fd, "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\n"
+                     "try /view, /frame or /stream\n");
+    }
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : 8080;
+    signal(SIGPIPE, SIG_IGN);
+
+    hittable_list objects = random_scene();
+    hittable *world = build_bvh(std::vector<hittable*>(objects.objects().begin(),
+                                                       objects.objects().end()),
+                                std::thread::hardware_concurrency());
+    scene_lights lights;
+    preview_renderer renderer(*world, lights);
+    std::thread render_thread(&preview_renderer::run, &renderer);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    // Local only: there's no authentication of any sort.
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0
+        || listen(listener, 16) < 0) {
+        perror("server: can't listen");
+        return 1;
+    }
+    std::cerr << "server: listening on http://127.0.0.1:" << port << "/" << std::endl;
+
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        std::thread(handle_connection, fd, std::ref(renderer)).detach();
+    }
+}
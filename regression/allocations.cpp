@@ -0,0 +1,189 @@
+// Checks that rendering doesn't touch the heap once it's going: renders a
+// few frames of several scenes on the same workers and band buffers, and
+// counts the allocations made after the first frame, which should be none.
+// The first frame is allowed to allocate, since that's when the band
+// buffers grow to size.
+//
+// Also checks the frames come out the same, since nothing carried over from
+// one frame to the next should change the image.
+//
+// The image textures get a cache too small for the tiles a frame needs, so
+// every frame reads tiles again and drops others, which mustn't allocate
+// either.
+//
+// usage: allocations
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "allocation_counter.h"
+#include "band_renderer.h"
+#include "camera.h"
+#include "render.h"
+#include "render_workers.h"
+#include "sampler.h"
+#include "scenes.h"
+
+const int nx = 32;
+const int ny = 24;
+const int samples = 2;
+const int frames = 3;
+
+struct test_scene {
+    test_scene() : world(nullptr), textures(nullptr) {}
+
+    std::string name;
+    hittable *world;
+    scene_lights lights;
+    // The cache its image textures use, if it has any.
+    texture_cache *textures;
+};
+
+// A 'size' square PPM of stripes, different for each 'seed', so every tile
+// of every image differs.
+bool
+write_image(const std::string &path, int size, int seed)
+{
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out << "P6\n" << size << " " << size << "\n255\n";
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            out.put(char((x * (seed + 3)) & 255));
+            out.put(char((y * (seed + 5)) & 255));
+            out.put(char(((x + y) * 7 + seed * 64) & 255));
+        }
+    }
+    return bool(out);
+}
+
+// Renders 'frames' frames into 'images', returning the number of
+// allocations made after the first one.  'tile_loads' is set to the number
+// of texture tiles read after the first one.
+size_t
+render_frames(const test_scene &scene, band_renderer &renderer,
+              std::vector<std::vector<vec3<> > > &images, size_t &tile_loads)
+{
+    camera cam(vec3<>(13, 2, 3), vec3<>(0, 0, 0), vec3<>(0, 1, 0),
+               20, float(nx)/float(ny), 0.1, 10.0);
+    std::vector<vec3<> > *image = nullptr;
+    int next_row = 0;
+
+    auto render_band = [&](int first_row, int end_row, vec3<> *pixels) {
+        sobol_sampler pixel_sampler(samples);
+        for (int y = first_row; y < end_row; y++) {
+            for (int x = 0; x < nx; x++) {
+                pixels[(y - first_row)*nx + x] =
+                    trace_pixel(cam, *scene.world, scene.lights, pixel_sampler,
+                                x, ny-1 - y, nx, ny, 0, samples, 8);
+            }
+        }
+        current_sampler() = nullptr;
+    };
+    auto write_band = [&](const std::vector<vec3<> > &pixels) {
+        std::copy(pixels.begin(), pixels.end(), image->begin() + next_row*nx);
+        next_row += pixels.size() / nx;
+    };
+
+    size_t after_first = 0;
+    size_t loads_after_first = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        if (frame == 1) {
+            after_first = heap_allocations();
+            loads_after_first = scene.textures ? scene.textures->loads() : 0;
+        }
+        image = &images[frame];
+        next_row = 0;
+        renderer.render(nx, ny, render_band, write_band);
+    }
+    size_t allocations = heap_allocations() - after_first;
+    tile_loads = (scene.textures ? scene.textures->loads() : 0) - loads_after_first;
+    return allocations;
+}
+
+int main()
+{
+    const char *tmpdir = getenv("TMPDIR");
+    std::string directory = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp")
+                          + "/allocations.XXXXXX";
+    if (!mkdtemp(&directory[0])) {
+        perror("allocations: can't make a directory for the images");
+        return 1;
+    }
+    std::vector<std::string> image_paths;
+    for (int i = 0; i < 4; i++) {
+        image_paths.push_back(directory + "/image" + std::to_string(i) + ".ppm");
+        if (!write_image(image_paths[i], 256, i)) {
+            std::cerr << image_paths[i] << ": couldn't write" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<test_scene> scenes(6);
+    std::list<hittable*> objects = random_scene().objects();
+    scenes[0].name = "random (bvh)";
+    scenes[0].world = build_bvh(std::vector<hittable*>(objects.begin(), objects.end()), 1);
+    reset_scene_seed();
+    scenes[1].name = "random (list)";
+    scenes[1].world = new hittable_list(random_scene());
+    reset_scene_seed();
+    scenes[2].name = "lights";
+    scenes[2].lights = scene_lights(false);
+    scenes[2].world = lights_scene(scenes[2].lights);
+    reset_scene_seed();
+    scenes[3].name = "fog";
+    scenes[3].world = fog_scene();
+    reset_scene_seed();
+    scenes[4].name = "textures";
+    texture_cache textures;
+    scenes[4].world = textures_scene(textures, std::vector<std::string>());
+    reset_scene_seed();
+    // One tile per shard, fewer than a frame of this scene reads.
+    scenes[5].name = "images";
+    texture_cache image_tiles(texture_cache::shard_count * sizeof(texture_cache::tile));
+    scenes[5].textures = &image_tiles;
+    scenes[5].world = textures_scene(image_tiles, image_paths);
+
+    // Odd sizes, so bands come in different sizes and workers don't line up
+    // with them.
+    render_workers workers(3);
+    band_renderer renderer(workers, 5, 2);
+
+    int failures = 0;
+    for (size_t s = 0; s < scenes.size(); s++) {
+        std::vector<std::vector<vec3<> > > images(frames, std::vector<vec3<> >(nx * ny));
+        size_t tile_loads;
+        size_t allocations = render_frames(scenes[s], renderer, images, tile_loads);
+        bool same = true;
+        for (int frame = 1; frame < frames; frame++) {
+            for (int i = 0; i < nx * ny; i++) {
+                same = same && (images[frame][i] - images[0][i]).squared_length() == 0;
+            }
+        }
+
+        std::cout << scenes[s].name << ": " << allocations
+                  << " allocations after the first frame";
+        if (scenes[s].textures) {
+            std::cout << ", " << tile_loads << " tiles read";
+        }
+        if (!same) {
+            std::cout << ", frames differ";
+        }
+        // A cache that never misses after the first frame wouldn't show
+        // reading tiles doesn't allocate.
+        bool ok = allocations == 0 && same && (!scenes[s].textures || tile_loads > 0);
+        std::cout << (ok ? "  ok" : "  FAILED") << std::endl;
+        failures += !ok;
+    }
+
+    for (size_t i = 0; i < image_paths.size(); i++) {
+        unlink(image_paths[i].c_str());
+        unlink((image_paths[i] + ".mip").c_str());
+    }
+    rmdir(directory.c_str());
+    return failures ? 1 : 0;
+}
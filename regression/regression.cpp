@@ -0,0 +1,187 @@
+// Renders a few small scenes with scene1's renderer and checks them:
+//  - every thread count and tile size has to give a bit-identical image, and
+//  - the image has to be within a tolerance of the stored reference, so small
+//    floating point differences between compilers and machines pass but real
+//    changes to the output don't.
+//
+// usage: regression [--update] [path to scene1's scene]
+// --update writes the renders over the references instead of checking them,
+// for when the output is meant to change.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct test_case {
+    const char *name;
+    const char *settings;
+};
+
+// Kept small, so the whole run takes a few seconds.
+const char *common_settings = "--width 48 --height 32 --format ppm";
+
+const test_case cases[] = {
+    {"random", "--samples 8 --sampler random"},
+    {"random_lazy_bvh", "--samples 8 --sampler sobol --bvh lazy"},
+    {"instanced", "--samples 4 --sampler halton --scene instanced"},
+    {"lights", "--samples 8 --sampler stratified --scene lights"},
+    {"lights_no_nee", "--samples 8 --sampler sobol --scene lights --nee 0"},
+    {"refraction", "--samples 4 --sampler sobol --scene refraction --depth 8"},
+    {"denoised", "--samples 4 --sampler sobol --denoise 1"},
+    {"textures", "--samples 4 --sampler sobol --scene textures"},
+    {"fog", "--samples 4 --sampler sobol --scene fog --depth 8"},
+};
+
+// Ways of splitting up the work that must not change the image.
+const char *schedules[] = {
+    "--threads 1 --tile 32",
+    "--threads 3 --tile 1",
+    "--threads 4 --tile 5 --window 2",
+};
+
+// Root mean square difference per channel, in 8-bit steps.
+const double tolerance = 1.0;
+
+struct image {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+bool
+read_ppm(const std::string &path, image &img)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string magic;
+    int max_value;
+    if (!(in >> magic >> img.width >> img.height >> max_value)
+        || magic != "P6" || max_value != 255) {
+        std::cerr << path << ": not a binary 8-bit PPM" << std::endl;
+        return false;
+    }
+    in.get();
+    img.pixels.resize(img.width * img.height * 3);
+    if (!in.read(reinterpret_cast<char *>(&img.pixels[0]), img.pixels.size())) {
+        std::cerr << path << ": truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+double
+rms_difference(const image &a, const image &b)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        double d = double(a.pixels[i]) - b.pixels[i];
+        sum += d * d;
+    }
+    return sqrt(sum / a.pixels.size());
+}
+
+bool
+render(const std::string &scene, const test_case &c, const char *schedule,
+       const std::string &output)
+{
+    std::ostringstream command;
+    command << scene << " " << common_settings << " " << c.settings << " "
+            << schedule << " --output '" << output << "' 2>/dev/null";
+    if (std::system(command.str().c_str()) != 0) {
+        std::cerr << c.name << ": '" << command.str() << "' failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    bool update = false;
+    std::string scene = "../scene1/scene";
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--update") {
+            update = true;
+        } else {
+            scene = argv[i];
+        }
+    }
+
+    // Renders go in a directory of their own, so runs at the same time (or
+    // anyone else's files) can't get mixed up with them.
+    const char *tmpdir = getenv("TMPDIR");
+    std::string directory = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp")
+                          + "/regression.XXXXXX";
+    if (!mkdtemp(&directory[0])) {
+        perror("regression: can't make a directory for the renders");
+        return 1;
+    }
+
+    int failures = 0;
+    for (const test_case &c : cases) {
+        std::string reference_path = std::string("references/") + c.name + ".ppm";
+        std::string output = directory + "/" + c.name + ".ppm";
+
+        image first;
+        bool ok = true;
+        for (const char *schedule : schedules) {
+            image rendered;
+            if (!render(scene, c, schedule, output) || !read_ppm(output, rendered)) {
+                ok = false;
+                break;
+            }
+            if (schedule == schedules[0]) {
+                first = rendered;
+            } else if (rendered.pixels != first.pixels) {
+                std::cerr << c.name << ": '" << schedule << "' doesn't match '"
+                          << schedules[0] << "'" << std::endl;
+                ok = false;
+            }
+        }
+
+        if (update) {
+            if (ok) {
+                std::ofstream out(reference_path.c_str(), std::ios::binary);
+                out << "P6\n" << first.width << " " << first.height << "\n255\n";
+                out.write(reinterpret_cast<const char *>(&first.pixels[0]),
+                          first.pixels.size());
+                std::cout << c.name << ": updated " << reference_path << std::endl;
+            }
+            failures += !ok;
+            continue;
+        }
+
+        image reference;
+        if (ok && read_ppm(reference_path, reference)) {
+            if (reference.width != first.width || reference.height != first.height) {
+                std::cerr << c.name << ": reference is a different size" << std::endl;
+                ok = false;
+            } else {
+                double difference = rms_difference(first, reference);
+                ok = difference <= tolerance;
+                std::cout << c.name << ": rms difference " << difference;
+            }
+        } else {
+            ok = false;
+        }
+        std::cout << (ok ? "  ok" : "  FAILED") << std::endl;
+        failures += !ok;
+    }
+
+    for (const test_case &c : cases) {
+        unlink((directory + "/" + c.name + ".ppm").c_str());
+    }
+    rmdir(directory.c_str());
+
+    if (failures) {
+        std::cout << failures << " of " << sizeof(cases)/sizeof(*cases)
+                  << " failed" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// Checks that the hierarchies cope with objects that have no bounding box:
+// random_scene() plus an endless ground plane and an instance of an empty
+// bvh_node goes through build_bvh(), bvh_node, lazy_bvh_node and
+// static_scene, and a fan of rays has to hit exactly what a plain
+// hittable_list of the same objects hits, at the same distance.  Also
+// hierarchies of nothing but unbounded objects.
+//
+// usage: unbounded
+#include <cmath>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+#include "bvh.h"
+#include "bvh_build.h"
+#include "instance.h"
+#include "lazy_bvh.h"
+#include "scenes.h"
+#include "static_scene.h"
+
+/* The plane y = height, which goes on forever, so it has no box. */
+class plane : public hittable {
+public:
+    plane(float height) : m_height(height) {}
+
+    virtual bool hit(const ray<float> &r, float t_min, float t_max,
+                     hit_record &rec) const
+    {
+        if (r.direction().y() == 0) {
+            return false;
+        }
+        float t = (m_height - r.origin().y()) / r.direction().y();
+        if (t <= t_min || t >= t_max) {
+            return false;
+        }
+        rec.t = t;
+        rec.p = r.point_at_parameter(t);
+        rec.normal = vec3<float>(0, 1, 0);
+        rec.mat_ptr = nullptr;
+        rec.u = rec.p.x() - floor(rec.p.x());
+        rec.v = rec.p.z() - floor(rec.p.z());
+        rec.uv_scale = 1;
+        return true;
+    }
+
+    virtual bool bounding_box(aabb &) const
+    {
+        return false;
+    }
+
+private:
+    float m_height;
+};
+
+// Rays from around random_scene()'s camera, some down onto the plane, some
+// into the spheres and some up into the sky.
+std::vector<ray<float> >
+ray_fan()
+{
+    std::vector<ray<float> > rays;
+    vec3<float> origin(13, 2, 3);
+    for (int i = 0; i < 40; i++) {
+        for (int j = 0; j < 30; j++) {
+            vec3<float> target(-10 + i * 0.5f, -3 + j * 0.25f, -6 + j * 0.4f);
+            rays.push_back(ray<float>(origin, target - origin));
+        }
+    }
+    return rays;
+}
+
+// Counts the rays 'hit' gets differently from the list.
+template<typename Hit> int
+compare(const hittable &reference, Hit hit)
+{
+    std::vector<ray<float> > rays = ray_fan();
+    int differences = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        hit_record expected, got;
+        bool expect_hit = reference.hit(rays[i], 0.001, FLT_MAX, expected);
+        bool got_hit = hit(rays[i], got);
+        if (expect_hit != got_hit || (expect_hit && expected.t != got.t)) {
+            differences++;
+        }
+    }
+    return differences;
+}
+
+int
+check(const std::string &name, int differences)
+{
+    std::cout << name << ": " << differences << " rays differ"
+              << (differences ? "  FAILED" : "  ok") << std::endl;
+    return differences ? 1 : 0;
+}
+
+int main()
+{
+    std::list<hittable*> objects = random_scene().objects();
+    objects.push_back(new plane(-0.5));
+    objects.push_back(new instance(new bvh_node(std::vector<hittable*>()),
+                                   transform::translate(vec3<float>(1, 2, 3))));
+    std::vector<hittable*> object_vector(objects.begin(), objects.end());
+    hittable_list reference(objects);
+
+    auto hit_with = [](const hittable *h) {
+        return [h](const ray<float> &r, hit_record &rec) {
+            return h->hit(r, 0.001, FLT_MAX, rec);
+        };
+    };
+
+    int failures = 0;
+    failures += check("build_bvh", compare(reference, hit_with(build_bvh(object_vector, 2))));
+    failures += check("bvh_node", compare(reference, hit_with(new bvh_node(object_vector))));
+    failures += check("lazy_bvh_node",
+                      compare(reference, hit_with(new lazy_bvh_node(objects))));
+
+    // static_scene only holds one primitive type, so everything goes in as
+    // an instance.
+    static_scene<instance, lambertian> typed;
+    material_ref gray = typed.add_material(lambertian(vec3<float>(0.5, 0.5, 0.5)));
+    for (auto it = objects.begin(); it != objects.end(); it++) {
+        typed.add(instance(*it, transform()), gray);
+    }
+    typed.build();
+    failures += check("static_scene", compare(reference,
+                                              [&typed](const ray<float> &r, hit_record &rec) {
+        material_ref material;
+        return typed.hit(r, 0.001, FLT_MAX, rec, material);
+    }));
+
+    std::list<hittable*> only_plane(1, new plane(-0.5));
+    std::vector<hittable*> only_plane_vector(only_plane.begin(), only_plane.end());
+    hittable_list plane_reference(only_plane);
+    failures += check("build_bvh, plane only",
+                      compare(plane_reference, hit_with(build_bvh(only_plane_vector, 1))));
+    failures += check("bvh_node, plane only",
+                      compare(plane_reference, hit_with(new bvh_node(only_plane_vector))));
+    failures += check("lazy_bvh_node, plane only",
+                      compare(plane_reference, hit_with(new lazy_bvh_node(only_plane))));
+
+    return failures ? 1 : 0;
+}
@@ -1,292 +1,301 @@
+#include <atomic>
 #include <cfloat>
-#include <future>
+#include <chrono>
+#include <fstream>
 #include <iostream>
-#include <list>
+#include <mutex>
 #include <vector>
 #include "ray.h"
 #include "sphere.h"
 #include "hittable_list.h"
+#include "bvh.h"
+#include "band_renderer.h"
+#include "bvh_build.h"
+#include "lazy_bvh.h"
+#include "instance.h"
 #include "camera.h"
+#include "config.h"
 #include "material.h"
-
-vec3<float> color(const ray<float> &r, const hittable *world, int depth=0) {
-    hit_record rec;
-    if (world->hit(r, 0.001, FLT_MAX, rec)) {
-        ray<float> scattered;
-        vec3<float> attenuation;
-        if (depth < 50 && rec.mat_ptr->scatter(r, rec, attenuation, scattered)){
-            return attenuation * color(scattered, world, depth+1);
-        } else {
-            return vec3<float>(0,0,0);
-        }
-    } else {
-        // Background
-        vec3<float> unit_direction(unit_vector(r.direction()));
-        float t = 0.5 * (unit_direction.y() + 1.0);
-        return (1.0f-t) * vec3<float>(1.0,1.0,1.0) + t * vec3<float>(0.5, 0.7, 1.0);
-    }
+#include "integrator.h"
+#include "light.h"
+#include "denoise.h"
+#include "render.h"
+#include "render_workers.h"
+#include "sampler.h"
+#include "scenes.h"
+#include "texture_cache.h"
+
+typedef std::chrono::steady_clock render_clock;
+render_clock::time_point render_start;
+std::once_flag first_pixel_done;
+
+inline double
+seconds_since_start()
+{
+    return std::chrono::duration<double>(render_clock::now() - render_start).count();
 }
 
-#ifndef SCALE
-#define SCALE 8
-#endif
-
-#ifndef PARALLEL
-#define PARALLEL 1
-#endif
-
-#ifndef ANTIALIAS
-#define ANTIALIAS 1
-#endif
-
-thread_local unsigned short rand_seed[3] = {0x1234, 0xabcd, 0x330e};
+void
+report_first_pixel()
+{
+    std::cerr << "time to first pixel: " << seconds_since_start() << "s" << std::endl;
+}
 
-vec3<>
-render_pixel(const camera &cam, const hittable_list &objects,
-             int j, int i, int ny, int nx)
+/* The sampler and antialiasing used to be picked with -D when building.
+ * They're template parameters now rather than checks in the per-pixel loop,
+ * so each combination still gets its own copy of the loop with the other
+ * branches compiled out, and render_frame() picks the copy once. */
+
+// Returns linear color; drawPixel() does the gamma correction.  If
+// 'features' is given it gets the first hits averaged over the samples.
+template<typename Sampler, bool Antialias> vec3<>
+render_pixel(const render_config &config, const camera &cam,
+             const hittable &objects, const scene_lights &lights,
+             Sampler &pixel_sampler, int j, int i, int ny, int nx,
+             pixel_features *features = nullptr)
 {
     // Capture multiple samples within a pixel
     vec3<float> col(0,0,0);
-    int ns = 100;
+    int ns = config.samples;
 
-// Make antialiasing optional for faster debug renders
-#if ANTIALIAS
-    for (int s=0; s < ns; s++) {
-        float u = float(i + erand48(rand_seed)) / float(nx);
-        float v = float(j + erand48(rand_seed)) / float(ny);
-        ray<float> &&r = cam.get_ray(u, v);
-        col += color(r, &objects);
+    // Make antialiasing optional for faster debug renders
+    if (Antialias) {
+        col = trace_pixel(cam, objects, lights, pixel_sampler, i, j, nx, ny,
+                          0, ns, config.max_depth, features);
+        col /= float(ns);
+    } else {
+        ns = 1;
+        current_sampler() = &pixel_sampler;
+        pixel_sampler.start_sample(i, j, 0);
+        ray<float> r = cam.get_ray(i/float(nx), j/float(ny));
+        col = color(r, &objects, lights, config.max_depth, 0, 0, features,
+                    ray_cone(0, cam.pixel_spread(ny)));
     }
-    col /= float(ns);
-#else
-    ray<float> r = cam.get_ray(i/float(nx), j/float(ny));
-    col = color(r, &objects);
-#endif
-
-    // Gamma correction
-    return vec3<float>(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
-}
 
-std::list<vec3<> >
-render_row(const camera &cam, const hittable_list &objects, int ny, int nx, int row)
-{
-    std::list<vec3<> > output;
-    for(int i = 0; i < nx; i++) {
-        output.push_back(render_pixel(cam, objects, row, i, ny, nx));
+    if (features) {
+        features->albedo /= float(ns);
+        features->depth /= ns;
+        if (features->normal.squared_length() > 0) {
+            features->normal.make_unit_vector();
+        }
     }
 
-    return output;
+    std::call_once(first_pixel_done, report_first_pixel);
+    return col;
 }
 
-std::list<std::vector<vec3<> > >
-render_rows(const camera &cam, const hittable_list &objects, int ny, int nx,
-            int startRow, int endRow)
+void
+write_header(std::ostream &out, const render_config &config, int nx, int ny)
 {
-    int numRows = 0;
-    std::list<std::vector<vec3<> > > output;
-    int rowMultiplier = 0;
-    for(int j = endRow-1; j >= startRow; j--) {
-        std::vector<vec3<> > row(nx);
-        for(int i = 0; i < nx; i++) {
-            row[i] = render_pixel(cam, objects, j, i, ny, nx);
-        }
-        output.push_back(row);
-        rowMultiplier += nx;
-        numRows++;
-    }
-
-    std::cerr << "Render Done [" << startRow << "," << endRow << ")"
-              << ", rows=" << numRows << std::endl;
-    return output;
+    out << (config.format == "ppm" ? "P6" : "P3") << "\n"
+        << nx << " " << ny << "\n255\n";
 }
 
 inline void
-drawPixel(const vec3<> &pixel)
+drawPixel(std::ostream &out, const render_config &config, const vec3<> &pixel)
 {
-    int ir = int(255.99 * pixel.r());
-    int ig = int(255.99 * pixel.g());
-    int ib = int(255.99 * pixel.b());
-
-    std::cout << ir << " " << ig << " " << ib << std::endl;
+    // Gamma correction.  Lights can make pixels brighter than white, clip
+    // them.
+    int ir = int(255.99 * fmin(sqrt(pixel.r()), 1.0));
+    int ig = int(255.99 * fmin(sqrt(pixel.g()), 1.0));
+    int ib = int(255.99 * fmin(sqrt(pixel.b()), 1.0));
+
+    if (config.format == "ppm") {
+        char rgb[3] = {char(ir), char(ig), char(ib)};
+        out.write(rgb, 3);
+    } else {
+        out << ir << " " << ig << " " << ib << "\n";
+    }
 }
 
-std::list<vec3<> >
-render_parallel(const camera &cam, const hittable_list &objects, int ny, int nx)
+/* Writes bands out as they come out of 'renderer' (see band_renderer.h),
+ * with the calling thread doing the writing while the workers render. */
+template<typename Sampler, bool Antialias> void
+render_parallel(const render_config &config, const camera &cam,
+                const hittable &objects, const scene_lights &lights,
+                int ny, int nx, band_renderer &renderer, std::ostream &out)
 {
-    typedef std::list<std::vector<vec3<> > > RenderedRow;
-    std::list<std::future<RenderedRow> > futures;
-    int threads = std::thread::hardware_concurrency();
-    int rowsPerThread = ceil((double)ny / threads);
-    for(int j = ny; j >= 0; j -= rowsPerThread) {
-        futures.push_back(std::async
-            (render_rows, cam, objects, ny, nx, fmax(j - rowsPerThread,0), j));
-        fprintf(stderr, "render_parallel: started future\n");
-    }
-
-    for(auto f = futures.begin(); f != futures.end(); f++) {
-        auto &&batch = f->get();
-        for(auto row = batch.begin(); row != batch.end(); row++) {
-            for(auto pixel = row->begin(); pixel != row->end(); pixel++) {
-                drawPixel(*pixel);
+    auto render_band = [&](int first_row, int end_row, vec3<> *pixels) {
+        Sampler pixel_sampler(config.samples);
+        for (int y = first_row; y < end_row; y++) {
+            for (int i = 0; i < nx; i++) {
+                // Row 0 of the image is the top, but j = 0 is the bottom of
+                // the camera's view.
+                pixels[(y - first_row)*nx + i] =
+                    render_pixel<Sampler, Antialias>(config, cam, objects, lights,
+                                                     pixel_sampler, ny-1 - y, i,
+                                                     ny, nx);
             }
         }
-        fprintf(stderr, "render_parallel: processed future\n");
-    }
-
-    return std::list<vec3<> >();
+        current_sampler() = nullptr;
+    };
+    auto write_band = [&](const std::vector<vec3<> > &pixels) {
+        for (auto pixel = pixels.begin(); pixel != pixels.end(); pixel++) {
+            drawPixel(out, config, *pixel);
+        }
+    };
+    renderer.render(nx, ny, render_band, write_band);
+    out.flush();
 }
 
-std::list<vec3<> >
-render(const camera &cam, const hittable_list &objects, int ny, int nx)
+/* Renders the whole frame with feature buffers, denoises it, and then writes
+ * it out.  The workers take bands of rows from a shared counter, like
+ * render_parallel(), but fill in the whole frame, since the denoiser needs
+ * all of it at once. */
+template<typename Sampler, bool Antialias> void
+render_denoised(const render_config &config, const camera &cam,
+                const hittable &objects, const scene_lights &lights,
+                int ny, int nx, render_workers &workers, std::ostream &out)
 {
-    std::list<vec3<> > output;
-    for(int j = ny-1; j >= 0; j--) {
-        for(int i = 0; i < nx; i++) {
-            output.push_back(render_pixel(cam, objects, j, i, ny, nx));
+    std::vector<vec3<> > image(nx * ny);
+    std::vector<pixel_features> features(nx * ny);
+
+    int band_rows = config.tile_size;
+    std::atomic<int> next_row(0);
+    auto job = [&](unsigned) {
+        Sampler pixel_sampler(config.samples);
+        for (int y = next_row.fetch_add(band_rows); y < ny;
+             y = next_row.fetch_add(band_rows)) {
+            for (int row = y; row < std::min(y + band_rows, ny); row++) {
+                for (int i = 0; i < nx; i++) {
+                    image[row*nx + i] = render_pixel<Sampler, Antialias>(
+                        config, cam, objects, lights, pixel_sampler, ny-1 - row, i,
+                        ny, nx, &features[row*nx + i]);
+                }
+            }
         }
+        current_sampler() = nullptr;
+    };
+    workers.start(job);
+    workers.wait();
+    std::cerr << "render done: " << seconds_since_start() << "s" << std::endl;
+
+    atrous_denoiser denoiser(workers.size());
+    denoiser.denoise(image, features, nx, ny);
+    std::cerr << "denoise done: " << seconds_since_start() << "s" << std::endl;
+
+    for(auto pixel = image.begin(); pixel != image.end(); pixel++) {
+        drawPixel(out, config, *pixel);
     }
-
-    return output;
 }
 
-hittable_list
-random_scene()
+template<typename Sampler, bool Antialias> void
+render_frame(const render_config &config, const camera &cam,
+             const hittable &objects, const scene_lights &lights,
+             int ny, int nx, band_renderer &renderer, std::ostream &out)
 {
-    std::list<hittable*> object_list;
-
-    auto ground_material = new lambertian(vec3<>(0.5, 0.5, 0.5));
-    object_list.push_back(new sphere(vec3<>(0,-1000,0), 1000, ground_material));
-
-    for(int a = -11; a < 11; a++) {
-        for(int b = -11; b < 11; b++) {
-            // XXX what's my verion of random_double?  erand48()
-            // Is the author making any assumptions about the range of
-            // random_double?
-            auto choose_mat = erand48(rand_seed);
-            vec3<> center(a + 0.9*erand48(rand_seed), 0.2, b + 0.9*erand48(rand_seed));
-
-            if ((center - vec3<>(4, 0.2, 0)).length() > 0.9) {
-                material *sphere_material = nullptr;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = vec3<>(erand48(rand_seed),
-                                         erand48(rand_seed),
-                                         erand48(rand_seed))
-                                * vec3<>(erand48(rand_seed),
-                                         erand48(rand_seed),
-                                         erand48(rand_seed));
-                    sphere_material = new lambertian(albedo);
-                } else if (choose_mat < 0.95) {
-                    // metal
-#if 0
-                    // TODO: one day implement these random functions that the
-                    // newer edition of the book uses.  They're a lot more
-                    // readable.
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-#else
-                    auto albedo = vec3<>(0.5*(1+erand48(rand_seed)),
-                                         0.5*(1+erand48(rand_seed)),
-                                         0.5*(1+erand48(rand_seed)));
-                    auto fuzz = 0.5*erand48(rand_seed);
-#endif
-                    sphere_material = new metal(albedo, fuzz);
-                } else {
-                    // glass
-                    sphere_material = new dielectric(1.5);
-                }
-
-                if (sphere_material) {
-                    object_list.push_back(new sphere(center, 0.2, sphere_material));
-                }
-            }
-        }
+    if (config.denoise) {
+        render_denoised<Sampler, Antialias>(config, cam, objects, lights, ny, nx,
+                                            renderer.workers(), out);
+    } else {
+        render_parallel<Sampler, Antialias>(config, cam, objects, lights, ny, nx,
+                                            renderer, out);
     }
+}
 
-    // hardcoded objects
-    auto material1 = new dielectric(1.5);
-    object_list.push_back(new sphere(vec3<>(0,1,0), 1.0, material1));
+template<typename Sampler> void
+render_frame(const render_config &config, const camera &cam,
+             const hittable &objects, const scene_lights &lights,
+             int ny, int nx, band_renderer &renderer, std::ostream &out)
+{
+    if (config.antialias) {
+        render_frame<Sampler, true>(config, cam, objects, lights, ny, nx, renderer, out);
+    } else {
+        render_frame<Sampler, false>(config, cam, objects, lights, ny, nx, renderer, out);
+    }
+}
 
-    auto material2 = new lambertian(vec3<>(0.4, 0.2, 0.1));
-    object_list.push_back(new sphere(vec3<>(-4, 1, 0), 1.0, material2));
+// Where the samples in a pixel go (see sampler.h).
+void
+render_frame(const render_config &config, const camera &cam,
+             const hittable &objects, const scene_lights &lights,
+             int ny, int nx, band_renderer &renderer, std::ostream &out)
+{
+    if (config.sampler == "stratified") {
+        render_frame<stratified_sampler>(config, cam, objects, lights, ny, nx,
+                                         renderer, out);
+    } else if (config.sampler == "halton") {
+        render_frame<halton_sampler>(config, cam, objects, lights, ny, nx,
+                                     renderer, out);
+    } else if (config.sampler == "sobol") {
+        render_frame<sobol_sampler>(config, cam, objects, lights, ny, nx,
+                                    renderer, out);
+    } else {
+        render_frame<random_sampler>(config, cam, objects, lights, ny, nx,
+                                     renderer, out);
+    }
+}
 
-    auto material3 = new metal(vec3<>(0.7, 0.6, 0.5), 0);
-    object_list.push_back(new sphere(vec3<>(4, 1, 0), 1.0, material3));
+hittable *
+build_scene(const render_config &config, scene_lights &lights,
+            texture_cache &textures)
+{
+    if (config.scene == "textures") {
+        return textures_scene(textures, config.textures);
+    } else if (config.scene == "fog") {
+        return fog_scene(config.fog);
+    } else if (config.scene == "spheres") {
+        return spheres_scene();
+    } else if (config.scene == "refraction") {
+        return refraction_scene();
+    } else if (config.scene == "instanced") {
+        // Instances of shared geometry instead of random_scene()'s
+        // individually allocated spheres.
+        return instanced_scene();
+    } else if (config.scene == "lights") {
+        // random_scene() at night, lit by a few glowing spheres instead of
+        // the sky.
+        lights = scene_lights(false);
+        return lights_scene(lights, config.nee);
+    }
 
-    hittable_list world(object_list);;
-    return world;
-    // leaking ground_material
+    // Acceleration structure for random_scene(): "none" tests every object
+    // for every ray, "eager" builds a bvh up front (on all cores), "lazy"
+    // builds a lazy_bvh_node that only splits as rays reach it, so the first
+    // pixels come out sooner.
+    hittable_list objects = random_scene();
+    if (config.bvh == "lazy") {
+        return new lazy_bvh_node(objects.objects());
+    } else if (config.bvh == "eager") {
+        return build_bvh(std::vector<hittable*>(objects.objects().begin(),
+                                                objects.objects().end()),
+                         config.thread_count());
+    }
+    return new hittable_list(objects);
 }
 
-int main() {
-    auto aspect_ratio = 3.0/2.0;
-    int nx = SCALE * 200;
-    int ny = nx / aspect_ratio;
-    int ns = 100;
-    std::cout << "P3\n" << nx << " " << ny << "\n255\n";
-    vec3<float> lower_left_corner(-2.0, -1.0, -1.0);
-    vec3<float> horizontal(4.0, 0.0, 0.0);
-    vec3<float> vertical(0, 2, 0);
-    vec3<float> origin(0, 0, 0);
-
-#if 0
-#if 0
-    // This is basically the first scene, but modified as new materials were
-    // developed, at least through chapter 8.
-    sphere s1(vec3<float>(-1, 0, -1), 0.5,
-              new metal(vec3<float>(0.8, 0.8, 0.8), 0.1));
-    sphere s2(vec3<float>(0,0,-1), 0.5,
-              new lambertian(vec3<float>(0.8, 0.3, 0.3)));
+camera
+scene_camera(const render_config &config, float aspect_ratio)
+{
+    if (config.scene == "spheres" || config.scene == "refraction") {
 #if 0
-    sphere s3(vec3<float>(1, 0, -1), 0.5,
-              new metal(vec3<float>(0.8, 0.6, 0.2), 0.8));
-#else
-    sphere s3(vec3<float>(1, 0, -1), 0.5, new dielectric(1.5));
-#endif
-    sphere floor(vec3<float>(0, -100.5, -1), 100,
-              new lambertian(vec3<float>(0.5, 0.5, 0.5)));
-    hittable *objects[] = {&s1, &s2, &s3, &floor};
-#elif 1
-    // This is a scene that shows off refraction.
-	sphere s1(vec3<>(0,0,-1), 0.5, new lambertian(vec3<>(0.1, 0.2, 0.5)));
-	sphere s2(vec3<>(1,0,-1), 0.5, new metal(vec3<>(0.8, 0.6, 0.2), 0.0));
-	sphere s3(vec3<>(-1,0,-1), 0.5, new dielectric(1.5));
-	sphere s4(vec3<>(-1,0,-1), -0.45, new dielectric(1.5)); // inside of bubble
-	sphere floor(vec3<>(0,-100.5,-1), 100, new lambertian(vec3<>(1.8, 0.8, 0.0)));
-    hittable *objects[] = {&s1, &s2, &s3, &s4, &floor};
-#endif
-
-    hittable_list list(objects, sizeof(objects)/sizeof(*objects));
+        // This is the default camera that was used in earlier chapters.
+        return camera(vec3<>(0, 0, 0), // lookfrom
+                      vec3<>(0, 0, -1), // lookat
+                      vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
+                      90, aspect_ratio);
+#elif 0
+        // Defocus blur scene
+        vec3<> lookfrom(3,3,2);
+        vec3<> lookat(0,0,-1);
+        vec3<> vup(0,1,0);
+        auto dist_to_focus = (lookfrom-lookat).length();
+        auto vertical_fov = 20;
+        auto aperture = 2.0;
+
+        return camera(lookfrom, lookat, vup, vertical_fov, aspect_ratio,
+                      aperture, dist_to_focus);
 #else
-    hittable_list list = random_scene();
+        // This is a different, more interesting camera angle introduced in
+        // chapter 10.
+        return camera(vec3<>(-2, 2, 1), // lookfrom
+                      vec3<>(0, 0, -1), // lookat
+                      vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
+                      90, aspect_ratio);
 #endif
+    }
 
-#if 0
-    // This is the default camera that was used in earlier chapters.
-    camera cam(vec3<>(0, 0, 0), // lookfrom
-               vec3<>(0, 0, -1), // lookat
-               vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
-               90, float(nx)/float(ny));
-#elif 0
-    // This is a different, more interesting camera angle introduced in
-    // chapter 10.
-    camera cam(vec3<>(-2, 2, 1), // lookfrom
-               vec3<>(0, 0, -1), // lookat
-               vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
-               90, float(nx)/float(ny));
-#elif 0
-    // Defocus blur scene
-    vec3<> lookfrom(3,3,2);
-    vec3<> lookat(0,0,-1);
-    vec3<> vup(0,1,0);
-    auto dist_to_focus = (lookfrom-lookat).length();
-    auto vertical_fov = 20;
-    auto aspect_ratio = 2.0;
-    auto aperture = 2.0;
-
-	camera cam(lookfrom, lookat, vup, vertical_fov, aspect_ratio, aperture, dist_to_focus);
-#elif 1
+#if 1
     // Final, random scene.
     vec3<> lookfrom(13,2,3);
     vec3<> lookat(0,0,0);
@@ -295,7 +304,8 @@ int main() {
     auto vertical_fov = 20;
     auto aperture = 0.1;
 
-    camera cam(lookfrom, lookat, vup, vertical_fov, aspect_ratio, aperture, dist_to_focus);
+    return camera(lookfrom, lookat, vup, vertical_fov, aspect_ratio, aperture,
+                  dist_to_focus);
 #else
     // This angle has a really low FOV but zoomed out quite far.  It seems to
     // have interesting visual artifacts that seems like aliasing of some sort.
@@ -304,27 +314,49 @@ int main() {
     // the issue is mostly around recast rays, not on the initial cast.  I
     // wonder if there's some bug (or bias) in the code that's supposed to
     // recast with some randomness.
-    camera cam(vec3<>(0, 0, 100), // lookfrom
-               vec3<>(0, 0, -1), // lookat
-               vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
-               1, float(nx)/float(ny));
+    return camera(vec3<>(0, 0, 100), // lookfrom
+                  vec3<>(0, 0, -1), // lookat
+                  vec3<>(0.0, 1.0, 0.0), // vup (twisting the camera)
+                  1, aspect_ratio);
 #endif
+}
 
-#if PARALLEL
-    auto frame = render_parallel(cam, list, ny, nx);
-#else
-    for(int j = ny-1; j >= 0; j--) {
-        for(int i = 0; i < nx; i++) {
-            // Capture multiple samples within a pixel
-            vec3<> col = render_pixel(cam, list, j, i, ny, nx);
+int main(int argc, char **argv) {
+    render_start = render_clock::now();
+    render_config config;
+    args_result args = parse_args(argc, argv, config);
+    if (args != args_ok) {
+        return args == args_help ? 0 : 1;
+    }
 
-            int ir = int(255.99 * col.r());
-            int ig = int(255.99 * col.g());
-            int ib = int(255.99 * col.b());
+    int nx = config.width;
+    int ny = config.image_height();
 
-            std::cout << ir << " " << ig << " " << ib << std::endl;
+    std::ofstream file;
+    if (config.output != "-") {
+        file.open(config.output.c_str(), std::ios::binary);
+        if (!file) {
+            std::cerr << config.output << ": can't open for writing" << std::endl;
+            return 1;
         }
     }
-#endif
+    std::ostream &out = config.output != "-" ? file : std::cout;
+    write_header(out, config, nx, ny);
+
+    scene_lights lights;
+    texture_cache textures(size_t(config.texture_cache_mb) << 20);
+    hittable &list = *build_scene(config, lights, textures);
+    std::cerr << "scene ready: " << seconds_since_start() << "s" << std::endl;
+
+    camera cam = scene_camera(config, config.aspect_ratio());
+
+    render_workers workers(config.thread_count());
+    band_renderer renderer(workers, config.tile_size, config.window_size());
+    render_frame(config, cam, list, lights, ny, nx, renderer, out);
+    std::cerr << "total time: " << seconds_since_start() << "s" << std::endl;
+    if (textures.loads()) {
+        std::cerr << "texture cache: " << textures.loads() << " tiles loaded, "
+                  << (textures.bytes() >> 20) << "MB held" << std::endl;
+    }
     return 0;
 }